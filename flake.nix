@@ -57,6 +57,7 @@
             pkgs.nix.dev
             pkgs.capnproto
             pkgs.boost
+            pkgs.boehmgc
 
             # xeus dependencies
             pkgs.xeus
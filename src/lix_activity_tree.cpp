@@ -0,0 +1,252 @@
+#include "lix_activity_tree.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace xeus_lix
+{
+    namespace
+    {
+        // longer log lines are cut, a progress display is not the place for them
+        constexpr size_t MAX_LOG_LINE_LENGTH = 200;
+
+        uint64_t field_int(const nix::Logger::Fields& fields, size_t i)
+        {
+            return i < fields.size() && fields[i].type == nix::Logger::Field::tInt ? fields[i].i : 0;
+        }
+
+        std::string field_string(const nix::Logger::Fields& fields, size_t i)
+        {
+            return i < fields.size() && fields[i].type == nix::Logger::Field::tString ? fields[i].s : "";
+        }
+
+        // `/nix/store/<hash>-hello-2.12.drv` -> `hello-2.12.drv`
+        std::string store_path_name(const std::string& path)
+        {
+            size_t base = path.rfind('/');
+            base = base == std::string::npos ? 0 : base + 1;
+            size_t dash = path.find('-', base);
+            return dash == std::string::npos ? path.substr(base) : path.substr(dash + 1);
+        }
+
+        std::string mebibytes(uint64_t bytes)
+        {
+            std::ostringstream out;
+            out << std::fixed << std::setprecision(1) << static_cast<double>(bytes) / (1 << 20);
+            return out.str();
+        }
+
+        bool counts_bytes(nix::ActivityType type)
+        {
+            return type == nix::actCopyPath || type == nix::actFileTransfer;
+        }
+    }
+
+    void activity_tree::start(nix::ActivityId id, nix::ActivityType type, const std::string& text, const nix::Logger::Fields& fields)
+    {
+        activity& act = m_running[id];
+        act.type = type;
+        act.text = text;
+        if (type == nix::actBuild)
+        {
+            act.drv_path = field_string(fields, 0);
+            act.drv_name = store_path_name(act.drv_path);
+        }
+    }
+
+    void activity_tree::stop(nix::ActivityId id)
+    {
+        auto it = m_running.find(id);
+        if (it == m_running.end())
+        {
+            return;
+        }
+        const activity& act = it->second;
+        if (act.type == nix::actBuilds || act.type == nix::actCopyPaths || counts_bytes(act.type))
+        {
+            progress& finished = m_finished[act.type];
+            finished.done += act.prog.done;
+            finished.expected += std::max(act.prog.expected, act.prog.done);
+            finished.failed += act.prog.failed;
+        }
+        m_running.erase(it);
+    }
+
+    void activity_tree::result(nix::ActivityId id, nix::ResultType type, const nix::Logger::Fields& fields)
+    {
+        auto it = m_running.find(id);
+        if (it == m_running.end())
+        {
+            return;
+        }
+        activity& act = it->second;
+        switch (type)
+        {
+        case nix::resBuildLogLine:
+        case nix::resPostBuildLogLine:
+        {
+            std::string line = field_string(fields, 0);
+            if (line.size() > MAX_LOG_LINE_LENGTH)
+            {
+                line.resize(MAX_LOG_LINE_LENGTH);
+                line += "…";
+            }
+            act.log_tail.push_back(std::move(line));
+            if (act.log_tail.size() > BUILD_LOG_TAIL_LINES)
+            {
+                act.log_tail.pop_front();
+            }
+            break;
+        }
+        case nix::resSetPhase:
+            act.phase = field_string(fields, 0);
+            break;
+        case nix::resProgress:
+            act.prog = { .done = field_int(fields, 0), .expected = field_int(fields, 1), .running = field_int(fields, 2), .failed = field_int(fields, 3) };
+            break;
+        case nix::resSetExpected:
+            // the number of builds or copies the parent activity is going to run
+            if (static_cast<nix::ActivityType>(field_int(fields, 0)) == nix::actBuild || static_cast<nix::ActivityType>(field_int(fields, 0)) == nix::actCopyPath)
+            {
+                act.prog.expected = std::max(act.prog.expected, field_int(fields, 1));
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    void activity_tree::reset_totals()
+    {
+        m_finished.clear();
+    }
+
+    activity_tree::progress activity_tree::total(nix::ActivityType type) const
+    {
+        progress sum;
+        auto add = [&](const progress& p) {
+            sum.done += p.done;
+            sum.expected += std::max(p.expected, p.done);
+            sum.running += p.running;
+            sum.failed += p.failed;
+        };
+        for (const auto& [id, act] : m_running)
+        {
+            if (act.type == type)
+            {
+                add(act.prog);
+            }
+        }
+        if (auto it = m_finished.find(type); it != m_finished.end())
+        {
+            add(it->second);
+        }
+        return sum;
+    }
+
+    std::string activity_tree::render() const
+    {
+        std::ostringstream out;
+
+        // totals, the way `nix build` shows them in its progress bar
+        const char* separator = "";
+        progress builds = total(nix::actBuilds);
+        if (builds.expected > 0)
+        {
+            out << separator << "built " << builds.done << "/" << builds.expected;
+            if (builds.running > 0)
+            {
+                out << " (" << builds.running << " running)";
+            }
+            if (builds.failed > 0)
+            {
+                out << " (" << builds.failed << " failed)";
+            }
+            separator = ", ";
+        }
+        progress copies = total(nix::actCopyPaths);
+        if (copies.expected > 0)
+        {
+            out << separator << "copied " << copies.done << "/" << copies.expected << " paths";
+            separator = ", ";
+        }
+        progress bytes = total(nix::actCopyPath);
+        progress transfers = total(nix::actFileTransfer);
+        bytes.done += transfers.done;
+        bytes.expected += transfers.expected;
+        if (bytes.expected > 0)
+        {
+            out << separator << mebibytes(bytes.done) << "/" << mebibytes(bytes.expected) << " MiB transferred";
+            separator = ", ";
+        }
+        if (*separator)
+        {
+            out << "\n";
+        }
+
+        // the running work itself; the aggregate activities only feed the totals
+        size_t listed = 0;
+        size_t unlisted = 0;
+        for (const auto& [id, act] : m_running)
+        {
+            bool shown = act.type == nix::actBuild || act.type == nix::actSubstitute
+                || act.type == nix::actFileTransfer || act.type == nix::actPostBuildHook;
+            if (!shown || act.text.empty())
+            {
+                continue;
+            }
+            if (listed == MAX_LISTED_ACTIVITIES)
+            {
+                ++unlisted;
+                continue;
+            }
+            ++listed;
+            if (act.type == nix::actBuild)
+            {
+                render_build(out, act);
+            }
+            else
+            {
+                out << act.text;
+                if (counts_bytes(act.type) && act.prog.expected > 0)
+                {
+                    out << " (" << mebibytes(act.prog.done) << "/" << mebibytes(act.prog.expected) << " MiB)";
+                }
+                out << "\n";
+            }
+        }
+        if (unlisted > 0)
+        {
+            out << "and " << unlisted << " more\n";
+        }
+        return out.str();
+    }
+
+    std::string activity_tree::render_build(const std::string& drv_path) const
+    {
+        std::ostringstream out;
+        for (const auto& [id, act] : m_running)
+        {
+            if (act.type == nix::actBuild && act.drv_path == drv_path)
+            {
+                render_build(out, act);
+            }
+        }
+        return out.str();
+    }
+
+    void activity_tree::render_build(std::ostream& out, const activity& act)
+    {
+        out << "building " << (act.drv_name.empty() ? act.text : act.drv_name);
+        if (!act.phase.empty())
+        {
+            out << " (" << act.phase << ")";
+        }
+        out << "\n";
+        for (const auto& line : act.log_tail)
+        {
+            out << "  > " << line << "\n";
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef XEUS_LIX_ACTIVITY_TREE_HPP
+#define XEUS_LIX_ACTIVITY_TREE_HPP
+
+#include "lix/libutil/logging.hh"
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <ostream>
+#include <string>
+
+namespace xeus_lix
+{
+    // what lix reports through the logger's activity interface (builds, substitutions,
+    // copies, downloads and their results) folded into the state a progress display
+    // needs: totals per kind of work, the running activities and, for every running
+    // build, the last lines of its log
+    class activity_tree
+    {
+    public:
+        void start(nix::ActivityId id, nix::ActivityType type, const std::string& text, const nix::Logger::Fields& fields);
+        void stop(nix::ActivityId id);
+        void result(nix::ActivityId id, nix::ResultType type, const nix::Logger::Fields& fields);
+
+        // forgets the totals, e.g. when a new cell starts; running activities stay
+        void reset_totals();
+        bool empty() const { return m_running.empty() && m_finished.empty(); }
+
+        // a plain text summary: one line of totals, then the running activities
+        std::string render() const;
+        // the running build of `drv_path` as render() lists it, or nothing
+        std::string render_build(const std::string& drv_path) const;
+
+    private:
+        struct progress
+        {
+            uint64_t done = 0;
+            uint64_t expected = 0;
+            uint64_t running = 0;
+            uint64_t failed = 0;
+        };
+
+        struct activity
+        {
+            nix::ActivityType type;
+            std::string text;
+            // the derivation of a build, and its name for display
+            std::string drv_path;
+            std::string drv_name;
+            std::string phase;
+            progress prog;
+            std::deque<std::string> log_tail;
+        };
+
+        progress total(nix::ActivityType type) const;
+        static void render_build(std::ostream& out, const activity& act);
+
+        // ordered by id, which is the order the activities started in
+        std::map<nix::ActivityId, activity> m_running;
+        // what the stopped activities got done, by type
+        std::map<nix::ActivityType, progress> m_finished;
+    };
+
+    // how many log lines are kept per running build
+    inline constexpr size_t BUILD_LOG_TAIL_LINES = 10;
+    // how many running activities are listed before the rest are only counted
+    inline constexpr size_t MAX_LISTED_ACTIVITIES = 8;
+}
+
+#endif
@@ -0,0 +1,15 @@
+#include "lix_attr_cache.hpp"
+
+namespace xeus_lix
+{
+    const attr_listing* attr_name_cache::find(const std::string& path) const
+    {
+        auto it = m_entries.find(path);
+        return it != m_entries.end() ? &it->second : nullptr;
+    }
+
+    const attr_listing& attr_name_cache::insert(const std::string& path, attr_listing listing)
+    {
+        return m_entries.insert_or_assign(path, std::move(listing)).first->second;
+    }
+}
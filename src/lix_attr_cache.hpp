@@ -0,0 +1,51 @@
+#ifndef XEUS_LIX_ATTR_CACHE_HPP
+#define XEUS_LIX_ATTR_CACHE_HPP
+
+#include "lix_symbol_index.hpp"
+
+#include "lix/libexpr/eval.hh"
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace xeus_lix
+{
+    // the forced attribute set behind a dotted path such as `pkgs.python3Packages`,
+    // together with its attribute names in sorted order
+    struct attr_listing
+    {
+        // keeps the set reachable for the garbage collector
+        nix::RootValue value;
+        // views into the symbol table, which never moves or frees its strings
+        name_list names;
+    };
+
+    // per-session memo of attribute listings keyed by their dotted path
+    // entries only depend on the binding of the path's first component, so they are
+    // dropped when that name is rebound and all at once when the scope is rebuilt
+    class attr_name_cache
+    {
+    public:
+        const attr_listing* find(const std::string& path) const;
+        const attr_listing& insert(const std::string& path, attr_listing listing);
+
+        // drops every entry whose root name satisfies `is_rebound`
+        template<typename Pred>
+        void invalidate_roots(Pred is_rebound)
+        {
+            std::erase_if(m_entries, [&](const auto& entry) { return is_rebound(root_of(entry.first)); });
+        }
+
+        void clear() { m_entries.clear(); }
+        size_t size() const { return m_entries.size(); }
+
+        static std::string_view root_of(std::string_view path) { return path.substr(0, path.find('.')); }
+
+    private:
+        std::unordered_map<std::string, attr_listing> m_entries;
+    };
+}
+
+#endif
@@ -0,0 +1,251 @@
+#include "lix_attr_index.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+
+namespace xeus_lix
+{
+    namespace
+    {
+        constexpr std::string_view INDEX_MAGIC = "xeus-lix attr index 1";
+
+        // the environment variables nixpkgs' impure.nix and config handling look at
+        constexpr std::string_view NIXPKGS_ENVIRONMENT[] = {
+            "NIX_PATH",
+            "NIXPKGS_CONFIG",
+            "NIXPKGS_ALLOW_UNFREE",
+            "NIXPKGS_ALLOW_BROKEN",
+            "NIXPKGS_ALLOW_INSECURE",
+            "NIXPKGS_ALLOW_UNSUPPORTED_SYSTEM",
+        };
+
+        // appends the name and contents of `path` to `out`, every file below it for a directory
+        void append_file_contents(const std::filesystem::path& path, std::string& out)
+        {
+            std::error_code ec;
+            if (std::filesystem::is_directory(path, ec))
+            {
+                std::vector<std::filesystem::path> files;
+                for (auto it = std::filesystem::recursive_directory_iterator(path, ec);
+                     !ec && it != std::filesystem::recursive_directory_iterator();
+                     it.increment(ec))
+                {
+                    if (it->is_regular_file(ec))
+                    {
+                        files.push_back(it->path());
+                    }
+                }
+                std::sort(files.begin(), files.end());
+                for (const auto& file : files)
+                {
+                    append_file_contents(file, out);
+                }
+                return;
+            }
+            std::ifstream in(path, std::ios::binary);
+            if (!in)
+            {
+                return;
+            }
+            std::stringstream contents;
+            contents << in.rdbuf();
+            out.append(path.string()).push_back('\0');
+            out.append(contents.str()).push_back('\0');
+        }
+
+        // splits off the next line of `rest`, or returns false if none is complete
+        bool next_line(std::string_view& rest, std::string_view& line)
+        {
+            size_t eol = rest.find('\n');
+            if (eol == std::string_view::npos)
+            {
+                return false;
+            }
+            line = rest.substr(0, eol);
+            rest.remove_prefix(eol + 1);
+            return true;
+        }
+    }
+
+    std::filesystem::path cache_directory()
+    {
+        if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+        {
+            return std::filesystem::path(xdg) / "xeus-lix";
+        }
+        if (const char* home = std::getenv("HOME"); home && *home)
+        {
+            return std::filesystem::path(home) / ".cache" / "xeus-lix";
+        }
+        return std::filesystem::temp_directory_path() / "xeus-lix";
+    }
+
+    std::string cache_file_name(const std::string& key, std::string_view extension)
+    {
+        std::ostringstream name;
+        name << std::hex << std::setw(16) << std::setfill('0') << std::hash<std::string>{}(key) << extension;
+        return name.str();
+    }
+
+    std::string nixpkgs_impure_inputs()
+    {
+        std::string inputs;
+        for (auto name : NIXPKGS_ENVIRONMENT)
+        {
+            const char* value = std::getenv(std::string(name).c_str());
+            inputs.append(name).push_back('=');
+            inputs.append(value ? value : "").push_back('\0');
+        }
+        if (const char* config = std::getenv("NIXPKGS_CONFIG"); config && *config)
+        {
+            append_file_contents(config, inputs);
+        }
+        if (const char* home = std::getenv("HOME"); home && *home)
+        {
+            std::filesystem::path dir(home);
+            append_file_contents(dir / ".config" / "nixpkgs" / "config.nix", inputs);
+            append_file_contents(dir / ".config" / "nixpkgs" / "overlays.nix", inputs);
+            append_file_contents(dir / ".config" / "nixpkgs" / "overlays", inputs);
+            append_file_contents(dir / ".nixpkgs" / "config.nix", inputs);
+        }
+        return inputs;
+    }
+
+    std::string loaded_source_origin(const std::string& store_path, const std::string& system)
+    {
+        std::string inputs = nixpkgs_impure_inputs();
+        std::ostringstream origin;
+        origin << store_path << '#' << system << '#' << std::hex << std::setw(16) << std::setfill('0')
+               << std::hash<std::string>{}(inputs);
+        return origin.str();
+    }
+
+    persistent_attr_index::persistent_attr_index(std::filesystem::path directory)
+        : m_directory(std::move(directory))
+    {
+    }
+
+    std::filesystem::path persistent_attr_index::file_for(const std::string& origin) const
+    {
+        return m_directory / cache_file_name(origin, ".idx");
+    }
+
+    persistent_attr_index::source_entries& persistent_attr_index::load(const std::string& origin)
+    {
+        auto [it, inserted] = m_sources.try_emplace(origin);
+        source_entries& entries = it->second;
+        if (!inserted)
+        {
+            return entries;
+        }
+
+        std::ifstream in(file_for(origin), std::ios::binary);
+        if (!in)
+        {
+            return entries;
+        }
+        std::stringstream contents;
+        contents << in.rdbuf();
+        const std::string& buffer = entries.buffers.emplace_back(contents.str());
+
+        std::string_view rest = buffer;
+        std::string_view line;
+        if (!next_line(rest, line) || line != INDEX_MAGIC || !next_line(rest, line) || line != origin)
+        {
+            return entries;
+        }
+        entries.file_valid = true;
+
+        while (next_line(rest, line))
+        {
+            if (!line.starts_with('@'))
+            {
+                continue;
+            }
+            std::string path(line.substr(1));
+            std::vector<std::string_view> names;
+            bool closed = false;
+            while (next_line(rest, line))
+            {
+                if (line.empty())
+                {
+                    closed = true;
+                    break;
+                }
+                names.push_back(line);
+            }
+            if (closed)
+            {
+                entries.paths.insert_or_assign(std::move(path), name_list(std::move(names)));
+            }
+        }
+        return entries;
+    }
+
+    const name_list* persistent_attr_index::find(const std::string& origin, const std::string& path)
+    {
+        auto& entries = load(origin);
+        auto it = entries.paths.find(path);
+        return it == entries.paths.end() ? nullptr : &it->second;
+    }
+
+    void persistent_attr_index::record(
+        const std::string& origin,
+        const std::string& path,
+        const std::vector<std::string_view>& names
+    )
+    {
+        auto& entries = load(origin);
+        if (entries.paths.contains(path) || path.find('\n') != std::string::npos)
+        {
+            return;
+        }
+
+        std::string section = "@" + path + "\n";
+        for (auto name : names)
+        {
+            if (name.empty() || name.find('\n') != std::string_view::npos)
+            {
+                return; // not representable, e.g. `"a\nb" = 1;`, so the path is not indexed at all
+            }
+            section.append(name).push_back('\n');
+        }
+        section.push_back('\n');
+
+        // keep the names in memory even if the file cannot be written
+        const std::string& stored = entries.buffers.emplace_back(section);
+        std::string_view rest = stored;
+        std::string_view line;
+        next_line(rest, line);
+        std::vector<std::string_view> views;
+        views.reserve(names.size());
+        while (next_line(rest, line) && !line.empty())
+        {
+            views.push_back(line);
+        }
+        entries.paths.emplace(path, name_list(std::move(views)));
+
+        std::error_code ec;
+        std::filesystem::create_directories(m_directory, ec);
+        if (ec)
+        {
+            return;
+        }
+        // a missing or foreign file is started afresh
+        std::ofstream out(file_for(origin), entries.file_valid ? std::ios::app | std::ios::binary : std::ios::trunc | std::ios::binary);
+        if (!out)
+        {
+            return;
+        }
+        if (!entries.file_valid)
+        {
+            out << INDEX_MAGIC << '\n' << origin << '\n';
+            entries.file_valid = true;
+        }
+        out << section;
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef XEUS_LIX_ATTR_INDEX_HPP
+#define XEUS_LIX_ATTR_INDEX_HPP
+
+#include "lix_symbol_index.hpp"
+
+#include "lix/libexpr/eval.hh"
+
+#include <deque>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace xeus_lix
+{
+    // `$XDG_CACHE_HOME/xeus-lix`, falling back to `~/.cache/xeus-lix`
+    std::filesystem::path cache_directory();
+
+    // a file name for the cache entry identified by `key`, which callers store inside
+    // the file as well to detect collisions
+    std::string cache_file_name(const std::string& key, std::string_view extension);
+
+    // what nixpkgs reads from outside the store when it is called without arguments: the
+    // NIX_PATH, NIXPKGS_CONFIG and NIXPKGS_ALLOW_* variables, its config file and overlays
+    std::string nixpkgs_impure_inputs();
+
+    // the origin of a file inside the store loaded with `:l`: its canonical path, the
+    // system, and a digest of what nixpkgs reads from the environment when it is called
+    // without arguments (its config file, its overlays and the NIXPKGS_ALLOW_* variables),
+    // since the same nixpkgs under other overlays has other attributes
+    std::string loaded_source_origin(const std::string& store_path, const std::string& system);
+
+    // an attribute set brought into scope by `:l` from a file inside the store
+    struct loaded_source
+    {
+        // the canonical path of the file, which names its contents for good, and what it
+        // is evaluated under, see loaded_source_origin
+        std::string origin;
+        nix::RootValue value;
+    };
+
+    // attribute names below loaded sources, persisted across kernel sessions
+    // a store path never changes, so names listed once for `pkgs.python3Packages` under
+    // a given nixpkgs stay valid and can be completed later without forcing anything.
+    // there is one append-only text file per source:
+    //
+    //     xeus-lix attr index 1
+    //     <origin>
+    //     @<dotted path>
+    //     <name>
+    //     ...
+    //     <empty line>
+    //
+    // a section without its closing empty line was cut short and is ignored
+    class persistent_attr_index
+    {
+    public:
+        explicit persistent_attr_index(std::filesystem::path directory);
+
+        // the sorted names recorded for `path` below `origin`, or null
+        const name_list* find(const std::string& origin, const std::string& path);
+        // stores the sorted `names` of `path` unless they are known already
+        // failing to write is not an error, the index is only a cache
+        void record(const std::string& origin, const std::string& path, const std::vector<std::string_view>& names);
+
+    private:
+        struct source_entries
+        {
+            // backing storage for the views, never modified once added
+            std::deque<std::string> buffers;
+            std::unordered_map<std::string, name_list> paths;
+            bool file_valid = false;
+        };
+
+        source_entries& load(const std::string& origin);
+        std::filesystem::path file_for(const std::string& origin) const;
+
+        std::filesystem::path m_directory;
+        std::unordered_map<std::string, source_entries> m_sources;
+    };
+}
+
+#endif
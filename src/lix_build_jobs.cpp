@@ -0,0 +1,122 @@
+#include "lix_build_jobs.hpp"
+
+#include <iomanip>
+#include <sstream>
+
+namespace xeus_lix
+{
+    namespace
+    {
+        // keeps `text` inside one cell of a markdown table
+        std::string table_cell(std::string_view text)
+        {
+            std::string cell;
+            for (char c : text)
+            {
+                if (c == '|')
+                {
+                    cell += "\\|";
+                }
+                else if (c == '\n')
+                {
+                    cell += "<br>";
+                }
+                else
+                {
+                    cell += c;
+                }
+            }
+            return cell;
+        }
+    }
+
+    std::string_view state_name(build_job::state s)
+    {
+        switch (s)
+        {
+        case build_job::state::running:
+            return "running";
+        case build_job::state::succeeded:
+            return "built";
+        case build_job::state::failed:
+            return "failed";
+        case build_job::state::killed:
+            return "killed";
+        }
+        return "unknown";
+    }
+
+    std::string_view outcome_name(build_target::outcome o)
+    {
+        switch (o)
+        {
+        case build_target::outcome::pending:
+            return "not built";
+        case build_target::outcome::valid:
+            return "already valid";
+        case build_target::outcome::built:
+            return "built";
+        case build_target::outcome::substituted:
+            return "substituted";
+        case build_target::outcome::failed:
+            return "failed";
+        }
+        return "unknown";
+    }
+
+    std::string elapsed(const build_job& job)
+    {
+        auto end = job.status == build_job::state::running ? std::chrono::steady_clock::now() : job.finished;
+        auto seconds = std::chrono::duration_cast<std::chrono::seconds>(end - job.started).count();
+        std::ostringstream out;
+        if (seconds >= 60)
+        {
+            out << seconds / 60 << 'm' << std::setw(2) << std::setfill('0');
+        }
+        out << seconds % 60 << 's';
+        return out.str();
+    }
+
+    std::string describe(const build_job& job)
+    {
+        std::ostringstream out;
+        out << '[' << job.id << "] ";
+        switch (job.status)
+        {
+        case build_job::state::running:
+            out << "building " << job.drv_path << " (" << elapsed(job) << ")\n";
+            break;
+        case build_job::state::succeeded:
+            out << "built " << job.drv_path << " in " << elapsed(job) << '\n' << job.message;
+            break;
+        case build_job::state::failed:
+            out << job.drv_path << " failed after " << elapsed(job) << ":\n" << job.message << '\n';
+            break;
+        case build_job::state::killed:
+            out << job.drv_path << " killed after " << elapsed(job) << '\n';
+            break;
+        }
+        return out.str();
+    }
+
+    std::string describe(const std::vector<build_target>& targets)
+    {
+        std::ostringstream md;
+        md << "| target | status | outputs | derivation |\n|---|---|---|---|\n";
+        for (const auto& target : targets)
+        {
+            std::string_view details = target.message;
+            if (target.result == build_target::outcome::failed)
+            {
+                details = details.substr(0, details.find('\n'));
+            }
+            else if (details.ends_with('\n'))
+            {
+                details.remove_suffix(1);
+            }
+            md << "| " << table_cell(target.name) << " | " << outcome_name(target.result) << " | "
+               << table_cell(details) << " | `" << target.drv_path << "` |\n";
+        }
+        return md.str();
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef XEUS_LIX_BUILD_JOBS_HPP
+#define XEUS_LIX_BUILD_JOBS_HPP
+
+#include "nlohmann/json.hpp"
+
+#include <kj/async.h>
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace xeus_lix
+{
+    // a build started with `:b <expr> &`. it runs on the lix event loop, which the
+    // evaluation thread keeps turning between cells and while a cell waits on the store,
+    // and reports into the output of the cell that started it through a display id
+    struct build_job
+    {
+        enum class state
+        {
+            running,
+            succeeded,
+            failed,
+            killed,
+        };
+
+        size_t id;
+        std::string drv_path;
+        std::string display_id;
+        // the header of the cell that started it, which its display is updated under long
+        // after that cell has finished
+        nlohmann::json parent_header;
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::time_point finished;
+        state status = state::running;
+        // the outputs once built, the error once failed
+        std::string message;
+        // destroying the promise cancels the build
+        std::optional<kj::Promise<void>> promise;
+    };
+
+    // one derivation of a `:b` over a list or attribute set of them. they are all built in
+    // a single batch, so the store schedules them side by side under max-jobs
+    struct build_target
+    {
+        enum class outcome
+        {
+            pending,
+            valid,
+            built,
+            substituted,
+            failed,
+        };
+
+        // the attribute path or list index it was found at, empty for a lone derivation
+        std::string name;
+        std::string drv_path;
+        outcome result = outcome::pending;
+        // the outputs once built, the error once failed
+        std::string message;
+    };
+
+    std::string_view state_name(build_job::state s);
+    std::string_view outcome_name(build_target::outcome o);
+    // how long the job has been running, or ran, as e.g. `1m05s`
+    std::string elapsed(const build_job& job);
+    // a line about the job's state, followed by its outputs or error once it has finished
+    std::string describe(const build_job& job);
+    // a markdown table of the targets, with how each one went and its outputs or the first
+    // line of its error
+    std::string describe(const std::vector<build_target>& targets);
+}
+
+#endif
@@ -0,0 +1,219 @@
+#include "lix_build_log.hpp"
+
+#include "lix/libstore/log-store.hh"
+#include "lix/libutil/error.hh"
+#include "lix/libutil/strings.hh"
+
+#include <kj/vector.h>
+
+namespace xeus_lix
+{
+    namespace
+    {
+        struct lookup_race
+        {
+            build_log_lookup result;
+            // by position among the stores asked, which is their order of preference
+            std::vector<std::optional<build_log>> logs;
+            std::vector<bool> done;
+            kj::Own<kj::PromiseFulfiller<void>> answered;
+
+            // decided once a store has the log and every store before it has answered
+            void settle()
+            {
+                if (!answered->isWaiting())
+                {
+                    return;
+                }
+                for (size_t i = 0; i < done.size(); ++i)
+                {
+                    if (!done[i])
+                    {
+                        return;
+                    }
+                    if (logs[i])
+                    {
+                        result.log = std::move(logs[i]);
+                        break;
+                    }
+                }
+                answered->fulfill();
+            }
+        };
+
+        kj::Promise<void> ask(nix::ref<nix::Store> store, nix::LogStore& logs, nix::StorePath drv_path, lookup_race& race, size_t index)
+        {
+            try
+            {
+                auto text = (co_await logs.getBuildLog(drv_path)).value();
+                if (text)
+                {
+                    race.logs[index] = build_log{ .uri = store->getUri(), .text = std::move(*text) };
+                }
+            }
+            catch (const std::exception& e)
+            {
+                race.result.errors.push_back(store->getUri() + ": " + e.what());
+            }
+            catch (const kj::Exception& e)
+            {
+                race.result.errors.push_back(store->getUri() + ": " + e.getDescription().cStr());
+            }
+            race.done[index] = true;
+            race.settle();
+        }
+
+        // the value of an option, which may be quoted to contain spaces; taken off `rest`
+        std::string take_word(std::string& rest)
+        {
+            std::string word;
+            size_t end;
+            if (!rest.empty() && (rest[0] == '"' || rest[0] == '\''))
+            {
+                end = rest.find(rest[0], 1);
+                if (end == std::string::npos)
+                {
+                    throw nix::Error("unterminated quote in %s", rest);
+                }
+                word = rest.substr(1, end - 1);
+                ++end;
+            }
+            else
+            {
+                end = rest.find_first_of(" \t\r\n");
+                word = rest.substr(0, end);
+            }
+            rest = end >= rest.size() ? "" : nix::trim(rest.substr(end));
+            return word;
+        }
+    }
+
+    kj::Promise<build_log_lookup> find_build_log(std::vector<nix::ref<nix::Store>> stores, nix::StorePath drv_path)
+    {
+        std::vector<std::pair<nix::ref<nix::Store>, nix::LogStore*>> log_stores;
+        for (auto& store : stores)
+        {
+            if (auto logs = dynamic_cast<nix::LogStore*>(&*store))
+            {
+                log_stores.emplace_back(store, logs);
+            }
+        }
+
+        auto answered = kj::newPromiseAndFulfiller<void>();
+        // sized up front: a lookup may finish before the next one is started
+        lookup_race race{
+            .logs = std::vector<std::optional<build_log>>(log_stores.size()),
+            .done = std::vector<bool>(log_stores.size()),
+            .answered = kj::mv(answered.fulfiller),
+        };
+        if (log_stores.empty())
+        {
+            co_return std::move(race.result);
+        }
+        {
+            kj::Vector<kj::Promise<void>> lookups;
+            for (size_t i = 0; i < log_stores.size(); ++i)
+            {
+                lookups.add(ask(log_stores[i].first, *log_stores[i].second, drv_path, race, i));
+            }
+            // leaving this scope drops the lookups still running, which cancels them
+            auto running = kj::joinPromises(lookups.releaseAsArray()).eagerlyEvaluate(nullptr);
+            co_await answered.promise;
+        }
+        co_return std::move(race.result);
+    }
+
+    log_filter parse_log_filter(std::string& arg)
+    {
+        log_filter filter;
+        std::string rest = nix::trim(arg);
+        while (rest.starts_with("--"))
+        {
+            std::string option = take_word(rest);
+            std::string value = take_word(rest);
+            if (value.empty())
+            {
+                throw nix::Error("%s requires a value", option);
+            }
+            if (option == "--tail")
+            {
+                auto lines = nix::string2Int<size_t>(value);
+                if (!lines)
+                {
+                    throw nix::Error("--tail expects a number of lines, not '%s'", value);
+                }
+                filter.tail = *lines;
+            }
+            else if (option == "--grep")
+            {
+                try
+                {
+                    filter.grep.emplace(value, std::regex::ECMAScript | std::regex::optimize);
+                }
+                catch (const std::regex_error& e)
+                {
+                    throw nix::Error("invalid regular expression '%s': %s", value, e.what());
+                }
+            }
+            else
+            {
+                throw nix::Error("unknown option '%s', :log takes --tail N and --grep <regex>", option);
+            }
+        }
+        arg = rest;
+        return filter;
+    }
+
+    std::string filter_log(std::string_view text, const log_filter& filter)
+    {
+        if (!filter.tail && !filter.grep)
+        {
+            return std::string(text);
+        }
+        std::vector<std::string_view> lines;
+        while (!text.empty())
+        {
+            size_t end = text.find('\n');
+            auto line = text.substr(0, end);
+            text = end == std::string_view::npos ? std::string_view{} : text.substr(end + 1);
+            if (!filter.grep || std::regex_search(line.begin(), line.end(), *filter.grep))
+            {
+                lines.push_back(line);
+            }
+        }
+        size_t first = filter.tail && *filter.tail < lines.size() ? lines.size() - *filter.tail : 0;
+        std::string out;
+        for (size_t i = first; i < lines.size(); ++i)
+        {
+            out.append(lines[i]);
+            out += '\n';
+        }
+        return out;
+    }
+
+    const build_log* build_log_cache::find(const std::string& drv_path) const
+    {
+        auto it = m_logs.find(drv_path);
+        return it == m_logs.end() ? nullptr : &it->second;
+    }
+
+    const build_log& build_log_cache::insert(const std::string& drv_path, build_log log)
+    {
+        if (auto it = m_logs.find(drv_path); it != m_logs.end())
+        {
+            m_bytes -= it->second.text.size();
+            m_logs.erase(it);
+            std::erase(m_order, drv_path);
+        }
+        while (!m_order.empty() && m_bytes + log.text.size() > MAX_CACHED_LOG_BYTES)
+        {
+            auto oldest = m_logs.find(m_order.front());
+            m_bytes -= oldest->second.text.size();
+            m_logs.erase(oldest);
+            m_order.pop_front();
+        }
+        m_bytes += log.text.size();
+        m_order.push_back(drv_path);
+        return m_logs.emplace(drv_path, std::move(log)).first->second;
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef XEUS_LIX_BUILD_LOG_HPP
+#define XEUS_LIX_BUILD_LOG_HPP
+
+#include "lix/libstore/store-api.hh"
+
+#include <kj/async.h>
+
+#include <deque>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace xeus_lix
+{
+    struct build_log
+    {
+        // the store it came from
+        std::string uri;
+        std::string text;
+    };
+
+    // the outcome of asking every log store for one derivation's log
+    struct build_log_lookup
+    {
+        std::optional<build_log> log;
+        // stores that failed to answer, as `uri: error`
+        std::vector<std::string> errors;
+    };
+
+    // asks all of `stores` that keep build logs for the log of `drv_path` at once
+    // the earliest of `stores` to have it wins, so the local store's own log is preferred
+    // to a substituter's. once that is decided the lookups still running are cancelled, so
+    // a slow or unreachable cache only costs time when no store before it has the log
+    kj::Promise<build_log_lookup> find_build_log(std::vector<nix::ref<nix::Store>> stores, nix::StorePath drv_path);
+
+    // the part of a log `:log` shows: the lines matching `grep`, if set, and of those the
+    // last `tail`, if set
+    struct log_filter
+    {
+        std::optional<size_t> tail;
+        std::optional<std::regex> grep;
+    };
+
+    // splits `--tail N` and `--grep <re>` off the front of a `:log` argument
+    log_filter parse_log_filter(std::string& arg);
+    std::string filter_log(std::string_view text, const log_filter& filter);
+
+    // the logs fetched in this session, by derivation path
+    // a missing log is not remembered, it may show up once the derivation is built.
+    // beyond MAX_CACHED_LOG_BYTES the logs fetched first are dropped
+    class build_log_cache
+    {
+    public:
+        const build_log* find(const std::string& drv_path) const;
+        const build_log& insert(const std::string& drv_path, build_log log);
+
+        size_t size() const { return m_logs.size(); }
+        size_t bytes() const { return m_bytes; }
+
+    private:
+        std::unordered_map<std::string, build_log> m_logs;
+        std::deque<std::string> m_order;
+        size_t m_bytes = 0;
+    };
+
+    inline constexpr size_t MAX_CACHED_LOG_BYTES = 64 * 1024 * 1024;
+    // `:log` publishes this much at a time, so a long log reaches the frontend in pieces
+    inline constexpr size_t LOG_CHUNK_BYTES = 64 * 1024;
+}
+
+#endif
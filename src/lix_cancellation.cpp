@@ -0,0 +1,107 @@
+#include "lix_cancellation.hpp"
+
+#include <cstdint>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "lix/libutil/error.hh"
+
+namespace xeus_lix
+{
+    namespace
+    {
+        std::atomic<cancellation_token*> s_interrupt_target = nullptr;
+        std::atomic<bool> s_shutdown = false;
+        thread_local std::function<void()> t_poll_hook;
+        // the hook publishes, and publishing must not end up back in it
+        thread_local bool t_polling = false;
+    }
+
+    cancellation_token::cancellation_token()
+        : m_event_fd(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+    {
+        if (m_event_fd < 0)
+        {
+            throw nix::SysError("creating cancellation eventfd");
+        }
+    }
+
+    cancellation_token::~cancellation_token()
+    {
+        ::close(m_event_fd);
+    }
+
+    void cancellation_token::reset()
+    {
+        m_cancelled.store(false);
+        uint64_t count;
+        while (::read(m_event_fd, &count, sizeof(count)) > 0)
+        {
+        }
+    }
+
+    void cancellation_token::cancel()
+    {
+        m_cancelled.store(true);
+        uint64_t one = 1;
+        [[maybe_unused]] auto written = ::write(m_event_fd, &one, sizeof(one));
+    }
+
+    void cancellation_token::check() const
+    {
+        run_poll_hook();
+        if (cancelled() || shutdown_requested())
+        {
+            throw nix::Interrupted("interrupted by the user");
+        }
+        nix::checkInterrupt();
+    }
+
+    void set_poll_hook(std::function<void()> hook)
+    {
+        t_poll_hook = std::move(hook);
+    }
+
+    void run_poll_hook()
+    {
+        if (t_poll_hook && !t_polling)
+        {
+            t_polling = true;
+            try
+            {
+                t_poll_hook();
+            }
+            catch (...)
+            {
+                t_polling = false;
+                throw;
+            }
+            t_polling = false;
+        }
+    }
+
+    void set_interrupt_target(cancellation_token* token)
+    {
+        s_interrupt_target.store(token);
+    }
+
+    void request_interrupt()
+    {
+        if (auto token = s_interrupt_target.load())
+        {
+            token->cancel();
+        }
+        nix::triggerInterrupt();
+    }
+
+    void request_shutdown()
+    {
+        s_shutdown.store(true);
+        request_interrupt();
+    }
+
+    bool shutdown_requested()
+    {
+        return s_shutdown.load();
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef XEUS_LIX_CANCELLATION_HPP
+#define XEUS_LIX_CANCELLATION_HPP
+
+#include "lix/libutil/async.hh"
+#include "lix/libutil/signals.hh"
+
+#include <kj/async.h>
+#include <kj/timer.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+namespace xeus_lix
+{
+    // cooperative cancellation of the work done for one request
+    // lix evaluation already stops at nix::checkInterrupt(), but a shell command waiting
+    // in poll or a store operation awaited through the event loop does not, so those
+    // check this token instead. `cancel()` is async-signal-safe: it only sets a flag
+    // and signals an eventfd that poll loops can wait on next to their own descriptors
+    class cancellation_token
+    {
+    public:
+        cancellation_token();
+        ~cancellation_token();
+
+        cancellation_token(const cancellation_token&) = delete;
+        cancellation_token& operator=(const cancellation_token&) = delete;
+
+        // called at the start of every request; a shutdown stays requested
+        void reset();
+        void cancel();
+
+        bool cancelled() const { return m_cancelled.load(std::memory_order_relaxed); }
+        // throws nix::Interrupted if the token or lix itself was interrupted, or the
+        // kernel is shutting down
+        void check() const;
+        // becomes readable once the token is cancelled
+        int wait_fd() const { return m_event_fd; }
+
+    private:
+        std::atomic<bool> m_cancelled = false;
+        int m_event_fd;
+    };
+
+    // the token SIGINT cancels, the interpreter's request token
+    void set_interrupt_target(cancellation_token* token);
+    // cancels the interrupt target and raises the lix interrupt; async-signal-safe
+    void request_interrupt();
+    // interrupts like request_interrupt, for good: requests that were queued behind the
+    // running one see shutdown_requested() and are dropped instead of run
+    void request_shutdown();
+    bool shutdown_requested();
+
+    // work the calling thread does whenever it looks at a token, e.g. redrawing the progress
+    // of a cell, which has to be published from the thread that runs the cell
+    void set_poll_hook(std::function<void()> hook);
+    void run_poll_hook();
+
+    // how often a blocked store operation looks at its token
+    inline constexpr std::chrono::milliseconds CANCELLATION_POLL_INTERVAL{ 20 };
+
+    namespace detail
+    {
+        template<typename T>
+        kj::Promise<T> cancelled_after(kj::Timer& timer, const cancellation_token& token)
+        {
+            return timer.afterDelay(CANCELLATION_POLL_INTERVAL.count() * kj::MILLISECONDS).then([&timer, &token]() -> kj::Promise<T> {
+                run_poll_hook();
+                if (token.cancelled())
+                {
+                    return KJ_EXCEPTION(FAILED, "interrupted by the user");
+                }
+                return cancelled_after<T>(timer, token);
+            });
+        }
+    }
+
+    // AsyncIoRoot::blockOn that gives up on `promise` as soon as `token` is cancelled
+    // the abandoned promise is destroyed, which cancels the operation behind it (a
+    // build, a substitution, a download), and nix::Interrupted is thrown in its place
+    template<typename T>
+    decltype(auto) block_on(nix::AsyncIoRoot& aio, const cancellation_token& token, kj::Promise<T>&& promise)
+    {
+        try
+        {
+            return aio.blockOn(promise.exclusiveJoin(detail::cancelled_after<T>(aio.kj.provider->getTimer(), token)));
+        }
+        catch (...)
+        {
+            token.check();
+            throw;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,339 @@
+#include "lix_completion_context.hpp"
+#include "lix_lexer.hpp"
+
+#include <algorithm>
+#include <optional>
+
+namespace xeus_lix
+{
+    namespace
+    {
+        enum class frame_kind
+        {
+            root,          // the cell itself, where `x = ...;` binds x
+            attrs,         // `{ ... }`, either a plain attribute set or lambda formals
+            rec_attrs,     // `rec { ... }`
+            list,
+            parens,
+            let_bindings,  // between `let` and `in`
+            expr_scope,    // a lambda body, let body or with body
+            with_header,   // between `with` and its `;`
+            assert_header, // between `assert` and its `;`
+        };
+
+        struct frame
+        {
+            frame_kind kind;
+            std::vector<std::string_view> names;
+            std::vector<std::string_view> with_exprs;
+            // identifiers that become lambda formals if this `{ ... }` is followed by `:`
+            std::vector<std::string_view> formals;
+            size_t with_start = 0;
+            // the body of `x: ...` or `{ ... }: ...`
+            bool lambda = false;
+            bool at_binding_start = false;
+            bool in_inherit = false;
+            int inherit_parens = 0;
+        };
+
+        bool has_bindings(frame_kind kind)
+        {
+            return kind == frame_kind::root || kind == frame_kind::attrs || kind == frame_kind::rec_attrs
+                || kind == frame_kind::let_bindings;
+        }
+
+        bool binds_names(frame_kind kind)
+        {
+            return kind == frame_kind::root || kind == frame_kind::rec_attrs || kind == frame_kind::let_bindings
+                || kind == frame_kind::expr_scope;
+        }
+
+        frame make_frame(frame_kind kind)
+        {
+            frame f{};
+            f.kind = kind;
+            f.at_binding_start = has_bindings(kind);
+            return f;
+        }
+
+        std::string_view trim(std::string_view s)
+        {
+            size_t first = s.find_first_not_of(" \t\r\n");
+            if (first == std::string_view::npos)
+            {
+                return {};
+            }
+            return s.substr(first, s.find_last_not_of(" \t\r\n") - first + 1);
+        }
+    }
+
+    completion_scope scope_at(const std::string_view code, size_t offset)
+    {
+        std::vector<token> tokens;
+        lexer lex(code.substr(0, std::min(offset, code.size())));
+        for (token t = lex.next(); t.kind != token_kind::eof; t = lex.next())
+        {
+            tokens.push_back(t);
+        }
+        const size_t n = tokens.size();
+
+        std::vector<frame> stack{ make_frame(frame_kind::root) };
+        std::string_view pending_at_name;
+
+        auto is_at = [&](size_t i, std::string_view s) {
+            return i < n && tokens[i].is(s);
+        };
+
+        // `a.b.c =` starting at token i
+        auto is_binding_at = [&](size_t i) {
+            size_t j = i + 1;
+            while (is_at(j, ".") && j + 1 < n
+                   && (tokens[j + 1].kind == token_kind::identifier || tokens[j + 1].kind == token_kind::string))
+            {
+                j += 2;
+            }
+            return is_at(j, "=");
+        };
+
+        // pops up to and including the innermost frame of one of the given kinds
+        auto pop_until = [&](frame_kind a, frame_kind b) -> std::optional<frame> {
+            auto it = std::find_if(stack.rbegin(), std::prev(stack.rend()), [&](const frame& f) {
+                return f.kind == a || f.kind == b;
+            });
+            if (it == std::prev(stack.rend()))
+            {
+                return std::nullopt; // a stray closer, ignore it
+            }
+            frame f = std::move(*it);
+            stack.erase(std::prev(it.base()), stack.end());
+            return f;
+        };
+
+        auto close_expr_scopes = [&] {
+            while (stack.size() > 1 && stack.back().kind == frame_kind::expr_scope)
+            {
+                stack.pop_back();
+            }
+        };
+
+        // a lambda written at the top level ends with its line: the next line that is not
+        // indented starts a new statement. frames opened inside its body go with it
+        auto close_root_lambdas = [&] {
+            auto first_lambda = stack.end();
+            for (auto it = std::next(stack.begin()); it != stack.end(); ++it)
+            {
+                if (it->kind != frame_kind::expr_scope)
+                {
+                    return; // still inside brackets or bindings, the line continues the expression
+                }
+                if (it->lambda && first_lambda == stack.end())
+                {
+                    first_lambda = it;
+                }
+            }
+            stack.erase(first_lambda, stack.end());
+        };
+
+        // whether `name` is bound by the code around the cursor rather than the REPL scope
+        auto bound_locally = [&](std::string_view name) {
+            return std::any_of(std::next(stack.begin()), stack.end(), [&](const frame& f) {
+                return binds_names(f.kind) && std::find(f.names.begin(), f.names.end(), name) != f.names.end();
+            });
+        };
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            const token& t = tokens[i];
+            if (t.newline_before && code[t.offset - 1] == '\n')
+            {
+                close_root_lambdas();
+            }
+            frame& top = stack.back();
+
+            if (top.in_inherit)
+            {
+                if (t.is("("))
+                {
+                    ++top.inherit_parens;
+                }
+                else if (t.is(")"))
+                {
+                    --top.inherit_parens;
+                }
+                else if (t.is(";"))
+                {
+                    top.in_inherit = false;
+                    top.at_binding_start = true;
+                }
+                else if (top.inherit_parens == 0 && t.kind == token_kind::identifier)
+                {
+                    top.names.push_back(t.text);
+                }
+                continue;
+            }
+
+            // cells are line oriented: a new line at the top level starts a new binding
+            if (stack.size() == 1 && t.newline_before)
+            {
+                top.at_binding_start = true;
+            }
+            const bool binding_start = top.at_binding_start;
+            top.at_binding_start = false;
+
+            if (t.kind == token_kind::identifier)
+            {
+                if (t.is("let"))
+                {
+                    stack.push_back(make_frame(frame_kind::let_bindings));
+                }
+                else if (t.is("rec") && is_at(i + 1, "{"))
+                {
+                    ++i;
+                    stack.push_back(make_frame(frame_kind::rec_attrs));
+                }
+                else if (t.is("in"))
+                {
+                    // the let bindings stay visible in its body
+                    if (auto f = pop_until(frame_kind::let_bindings, frame_kind::let_bindings))
+                    {
+                        f->kind = frame_kind::expr_scope;
+                        stack.push_back(std::move(*f));
+                    }
+                }
+                else if (t.is("with"))
+                {
+                    frame f = make_frame(frame_kind::with_header);
+                    f.with_start = t.offset + t.text.size();
+                    stack.push_back(std::move(f));
+                }
+                else if (t.is("assert"))
+                {
+                    stack.push_back(make_frame(frame_kind::assert_header));
+                }
+                else if (t.is("inherit") && binding_start)
+                {
+                    top.in_inherit = true;
+                }
+                else if (binding_start && is_binding_at(i))
+                {
+                    top.names.push_back(t.text);
+                }
+                else if (is_at(i + 1, ":"))
+                {
+                    // `x: body`
+                    ++i;
+                    frame f = make_frame(frame_kind::expr_scope);
+                    f.names.push_back(t.text);
+                    f.lambda = true;
+                    stack.push_back(std::move(f));
+                }
+                else if (is_at(i + 1, "@") && is_at(i + 2, "{"))
+                {
+                    // `args @ { ... }: body`
+                    pending_at_name = t.text;
+                }
+                else if (top.kind == frame_kind::attrs && i > 0 && (tokens[i - 1].is("{") || tokens[i - 1].is(",")))
+                {
+                    top.formals.push_back(t.text);
+                }
+                continue;
+            }
+
+            if (t.kind != token_kind::punct)
+            {
+                continue;
+            }
+
+            if (t.is("{"))
+            {
+                frame f = make_frame(frame_kind::attrs);
+                if (!pending_at_name.empty())
+                {
+                    f.formals.push_back(pending_at_name);
+                    pending_at_name = {};
+                }
+                stack.push_back(std::move(f));
+            }
+            else if (t.is("["))
+            {
+                stack.push_back(make_frame(frame_kind::list));
+            }
+            else if (t.is("("))
+            {
+                stack.push_back(make_frame(frame_kind::parens));
+            }
+            else if (t.is("}"))
+            {
+                auto f = pop_until(frame_kind::attrs, frame_kind::rec_attrs);
+                if (f && f->kind == frame_kind::attrs)
+                {
+                    // `{ a, b }: body` or `{ a, b } @ args: body`
+                    size_t j = i + 1;
+                    if (is_at(j, "@") && j + 1 < n && tokens[j + 1].kind == token_kind::identifier)
+                    {
+                        f->formals.push_back(tokens[j + 1].text);
+                        j += 2;
+                    }
+                    if (is_at(j, ":"))
+                    {
+                        frame body = make_frame(frame_kind::expr_scope);
+                        body.names = std::move(f->formals);
+                        body.lambda = true;
+                        stack.push_back(std::move(body));
+                        i = j;
+                    }
+                }
+            }
+            else if (t.is("]"))
+            {
+                pop_until(frame_kind::list, frame_kind::list);
+            }
+            else if (t.is(")"))
+            {
+                pop_until(frame_kind::parens, frame_kind::parens);
+            }
+            else if (t.is(";"))
+            {
+                if (top.kind == frame_kind::with_header)
+                {
+                    frame f = std::move(top);
+                    stack.pop_back();
+                    f.kind = frame_kind::expr_scope;
+                    // `with` over a name the surrounding code binds is not the REPL's value
+                    // of that name, and what the local one holds is not known here
+                    std::string_view with_expr = trim(code.substr(f.with_start, t.offset - f.with_start));
+                    if (!bound_locally(with_expr.substr(0, with_expr.find('.'))))
+                    {
+                        f.with_exprs.push_back(with_expr);
+                    }
+                    stack.push_back(std::move(f));
+                }
+                else if (top.kind == frame_kind::assert_header)
+                {
+                    stack.pop_back();
+                }
+                else
+                {
+                    // ends the binding, and with it any lambda or let body inside it
+                    close_expr_scopes();
+                    stack.back().at_binding_start = has_bindings(stack.back().kind);
+                }
+            }
+            else if (t.is(","))
+            {
+                close_expr_scopes();
+            }
+        }
+
+        completion_scope scope;
+        for (auto it = stack.rbegin(); it != stack.rend(); ++it)
+        {
+            if (binds_names(it->kind))
+            {
+                scope.names.insert(scope.names.end(), it->names.begin(), it->names.end());
+            }
+            scope.with_exprs.insert(scope.with_exprs.end(), it->with_exprs.begin(), it->with_exprs.end());
+        }
+        return scope;
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef XEUS_LIX_COMPLETION_CONTEXT_HPP
+#define XEUS_LIX_COMPLETION_CONTEXT_HPP
+
+#include <string_view>
+#include <vector>
+
+namespace xeus_lix
+{
+    // what the code surrounding a position brings into scope
+    struct completion_scope
+    {
+        // let bindings, rec attributes, lambda arguments and formals, and bindings made
+        // earlier in the cell
+        std::vector<std::string_view> names;
+        // source text of the enclosing `with <expr>;` expressions, innermost first
+        std::vector<std::string_view> with_exprs;
+    };
+
+    // finds the binders in scope at `offset` by walking the tokens in front of it
+    // the lix parser cannot recover from errors, and code being completed is usually
+    // incomplete, so this works on the token stream and tolerates unbalanced input.
+    // all views point into `code`
+    completion_scope scope_at(std::string_view code, size_t offset);
+}
+
+#endif
@@ -0,0 +1,37 @@
+#include "lix_doc_cache.hpp"
+
+namespace xeus_lix
+{
+    const std::string& doc_comment_cache::get(
+        const std::string& file,
+        bool immutable,
+        uint32_t line,
+        uint32_t column,
+        const std::function<std::string()>& fetch
+    )
+    {
+        auto [it, inserted] = m_files.try_emplace(file);
+        file_entry& entry = it->second;
+        if (!immutable)
+        {
+            std::error_code ec;
+            auto mtime = std::filesystem::last_write_time(file, ec);
+            auto size = ec ? 0 : std::filesystem::file_size(file, ec);
+            if (ec || mtime != entry.mtime || size != entry.size)
+            {
+                entry.docs.clear();
+                entry.mtime = mtime;
+                entry.size = size;
+            }
+        }
+
+        uint64_t key = (static_cast<uint64_t>(line) << 32) | column;
+        if (auto doc = entry.docs.find(key); doc != entry.docs.end())
+        {
+            ++m_hits;
+            return doc->second;
+        }
+        ++m_misses;
+        return entry.docs.emplace(key, fetch()).first->second;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef XEUS_LIX_DOC_CACHE_HPP
+#define XEUS_LIX_DOC_CACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+namespace xeus_lix
+{
+    // doc comments of lambdas keyed by their source position
+    // lix-doc reads and parses the whole file for every lookup, which is what makes
+    // hovering over `lib.strings` functions slow. entries of a file are dropped once its
+    // modification time or size changes; files in the store never change and are not
+    // even stat'ed
+    class doc_comment_cache
+    {
+    public:
+        // the doc comment at `line`:`column` of `file`, computed by `fetch` on a miss
+        const std::string& get(
+            const std::string& file,
+            bool immutable,
+            uint32_t line,
+            uint32_t column,
+            const std::function<std::string()>& fetch
+        );
+
+        size_t hits() const { return m_hits; }
+        size_t misses() const { return m_misses; }
+
+    private:
+        struct file_entry
+        {
+            std::filesystem::file_time_type mtime;
+            std::uintmax_t size = 0;
+            // keyed by line << 32 | column
+            std::unordered_map<uint64_t, std::string> docs;
+        };
+
+        std::unordered_map<std::string, file_entry> m_files;
+        size_t m_hits = 0;
+        size_t m_misses = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,266 @@
+#include "lix_doc_index.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+
+namespace xeus_lix
+{
+    namespace
+    {
+        constexpr std::string_view INDEX_MAGIC = "xeus-lix doc index 1";
+
+        // adds the words of `text` to `terms`, each counting `weight` times
+        void add_words(std::string_view text, uint32_t weight, bool split_camel, std::unordered_map<std::string, uint32_t>& terms)
+        {
+            auto add = [&](std::string_view word) {
+                if (word.size() < 2)
+                {
+                    return;
+                }
+                std::string lowered(word);
+                std::transform(lowered.begin(), lowered.end(), lowered.begin(), [](unsigned char c) {
+                    return static_cast<char>(std::tolower(c));
+                });
+                terms[lowered] += weight;
+            };
+
+            size_t i = 0;
+            while (i < text.size())
+            {
+                while (i < text.size() && !std::isalnum(static_cast<unsigned char>(text[i])))
+                {
+                    ++i;
+                }
+                size_t start = i;
+                while (i < text.size() && std::isalnum(static_cast<unsigned char>(text[i])))
+                {
+                    ++i;
+                }
+                std::string_view word = text.substr(start, i - start);
+                add(word);
+
+                if (split_camel)
+                {
+                    size_t part = 0;
+                    for (size_t j = 1; j <= word.size(); ++j)
+                    {
+                        if (j == word.size() || std::isupper(static_cast<unsigned char>(word[j])))
+                        {
+                            if (part != 0 || j != word.size())
+                            {
+                                add(word.substr(part, j - part));
+                            }
+                            part = j;
+                        }
+                    }
+                }
+            }
+        }
+
+        std::string first_line(std::string_view doc)
+        {
+            size_t start = 0;
+            while (start < doc.size())
+            {
+                size_t end = std::min(doc.find('\n', start), doc.size());
+                std::string_view line = doc.substr(start, end - start);
+                size_t first = line.find_first_not_of(" \t\r");
+                if (first != std::string_view::npos)
+                {
+                    line = line.substr(first, line.find_last_not_of(" \t\r") - first + 1);
+                    std::string summary(line.substr(0, 160));
+                    std::replace(summary.begin(), summary.end(), '\t', ' ');
+                    return summary;
+                }
+                start = end + 1;
+            }
+            return "";
+        }
+    }
+
+    void doc_search_index::add(std::string name, std::string_view doc)
+    {
+        std::replace_if(name.begin(), name.end(), [](char c) { return c == '\t' || c == '\n'; }, ' ');
+        std::unordered_map<std::string, uint32_t> terms;
+        // the name is weighted up: `:apropos concat` should find `concatStrings` first
+        add_words(name, 3, true, terms);
+        add_words(doc, 1, false, terms);
+
+        uint32_t id = static_cast<uint32_t>(m_docs.size());
+        m_docs.push_back({ .name = std::move(name), .summary = first_line(doc) });
+        add_terms(id, terms);
+    }
+
+    void doc_search_index::add_terms(uint32_t doc, const std::unordered_map<std::string, uint32_t>& terms)
+    {
+        for (const auto& [term, frequency] : terms)
+        {
+            m_postings[term].push_back({ .doc = doc, .frequency = frequency });
+        }
+    }
+
+    std::vector<doc_search_index::hit> doc_search_index::search(std::string_view query, size_t limit) const
+    {
+        std::unordered_map<std::string, uint32_t> words;
+        add_words(query, 1, false, words);
+
+        // documents matching more of the query words rank first, then by tf-idf
+        std::unordered_map<uint32_t, std::pair<uint32_t, double>> scores;
+        for (const auto& [word, _] : words)
+        {
+            auto it = m_postings.find(word);
+            if (it == m_postings.end())
+            {
+                continue;
+            }
+            double idf = std::log(1.0 + static_cast<double>(m_docs.size()) / static_cast<double>(it->second.size()));
+            for (const auto& p : it->second)
+            {
+                auto& [matched, score] = scores[p.doc];
+                ++matched;
+                score += p.frequency * idf;
+            }
+        }
+
+        std::vector<std::pair<uint32_t, std::pair<uint32_t, double>>> ranked(scores.begin(), scores.end());
+        auto better = [&](const auto& a, const auto& b) {
+            if (a.second != b.second)
+            {
+                return a.second > b.second;
+            }
+            return m_docs[a.first].name < m_docs[b.first].name;
+        };
+        size_t n = std::min(limit, ranked.size());
+        std::partial_sort(ranked.begin(), ranked.begin() + n, ranked.end(), better);
+
+        std::vector<hit> hits;
+        hits.reserve(n);
+        double best = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            best = std::max(best, ranked[i].second.second);
+        }
+        for (size_t i = 0; i < n; ++i)
+        {
+            const document& d = m_docs[ranked[i].first];
+            auto [matched, score] = ranked[i].second;
+            hits.push_back({ .name = d.name,
+                             .summary = d.summary,
+                             .matched = matched,
+                             .score = score,
+                             .relevance = best > 0 ? score / best : 1.0 });
+        }
+        return hits;
+    }
+
+    bool doc_search_index::better(const hit& a, const hit& b)
+    {
+        if (a.matched != b.matched)
+        {
+            return a.matched > b.matched;
+        }
+        if (a.relevance != b.relevance)
+        {
+            return a.relevance > b.relevance;
+        }
+        return a.name < b.name;
+    }
+
+    bool doc_search_index::indexes(const nix::Value& v) const
+    {
+        return m_source && v.type() == nix::nAttrs && (*m_source)->attrs == v.attrs;
+    }
+
+    bool doc_search_index::save(const std::filesystem::path& file, const std::string& key) const
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(file.parent_path(), ec);
+        if (ec)
+        {
+            return false;
+        }
+
+        std::vector<std::vector<std::pair<std::string_view, uint32_t>>> doc_terms(m_docs.size());
+        for (const auto& [term, postings] : m_postings)
+        {
+            for (const auto& p : postings)
+            {
+                doc_terms[p.doc].emplace_back(term, p.frequency);
+            }
+        }
+
+        // written to a temporary file and renamed, so a reader never sees half an index; the
+        // name is the process's own, another kernel may be saving the same index
+        auto tmp = file;
+        tmp += "." + std::to_string(::getpid()) + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::trunc | std::ios::binary);
+            if (!out)
+            {
+                return false;
+            }
+            out << INDEX_MAGIC << '\n' << key << '\n';
+            for (size_t i = 0; i < m_docs.size(); ++i)
+            {
+                out << m_docs[i].name << '\t' << m_docs[i].summary << '\t';
+                for (size_t j = 0; j < doc_terms[i].size(); ++j)
+                {
+                    out << (j == 0 ? "" : " ") << doc_terms[i][j].first << ':' << doc_terms[i][j].second;
+                }
+                out << '\n';
+            }
+            if (!out)
+            {
+                return false;
+            }
+        }
+        std::filesystem::rename(tmp, file, ec);
+        return !ec;
+    }
+
+    std::unique_ptr<doc_search_index> doc_search_index::load(const std::filesystem::path& file, const std::string& key)
+    {
+        std::ifstream in(file, std::ios::binary);
+        std::string line;
+        if (!in || !std::getline(in, line) || line != INDEX_MAGIC || !std::getline(in, line) || line != key)
+        {
+            return nullptr;
+        }
+
+        auto index = std::make_unique<doc_search_index>();
+        std::unordered_map<std::string, uint32_t> terms;
+        while (std::getline(in, line))
+        {
+            size_t name_end = line.find('\t');
+            size_t summary_end = name_end == std::string::npos ? name_end : line.find('\t', name_end + 1);
+            if (summary_end == std::string::npos)
+            {
+                return nullptr;
+            }
+
+            terms.clear();
+            std::string_view rest = std::string_view(line).substr(summary_end + 1);
+            while (!rest.empty())
+            {
+                size_t end = std::min(rest.find(' '), rest.size());
+                std::string_view entry = rest.substr(0, end);
+                size_t colon = entry.rfind(':');
+                if (colon == std::string_view::npos)
+                {
+                    return nullptr;
+                }
+                terms[std::string(entry.substr(0, colon))] = static_cast<uint32_t>(std::strtoul(std::string(entry.substr(colon + 1)).c_str(), nullptr, 10));
+                rest.remove_prefix(std::min(end + 1, rest.size()));
+            }
+
+            uint32_t id = static_cast<uint32_t>(index->m_docs.size());
+            index->m_docs.push_back({ .name = line.substr(0, name_end), .summary = line.substr(name_end + 1, summary_end - name_end - 1) });
+            index->add_terms(id, terms);
+        }
+        return index;
+    }
+}
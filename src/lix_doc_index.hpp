@@ -0,0 +1,74 @@
+#ifndef XEUS_LIX_DOC_INDEX_HPP
+#define XEUS_LIX_DOC_INDEX_HPP
+
+#include "lix/libexpr/eval.hh"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace xeus_lix
+{
+    // an inverted index from words to the documented values that mention them, for `:apropos`
+    // words are runs of ascii letters and digits, lowercased; camelCase names are split
+    // into their parts as well. hits are ranked by term frequency weighted with the
+    // inverse document frequency, and a word in the name counts as much as three in the text
+    class doc_search_index
+    {
+    public:
+        struct hit
+        {
+            std::string_view name;
+            std::string_view summary;
+            // how many of the query words the document contains
+            uint32_t matched;
+            double score;
+            // the score relative to the best hit of the same search, in (0, 1]; raw
+            // scores depend on the indexed corpus, so hits from two indexes are merged
+            // by this
+            double relevance;
+        };
+
+        void add(std::string name, std::string_view doc);
+        // the best `limit` documents for the words in `query`, best first
+        std::vector<hit> search(std::string_view query, size_t limit) const;
+        // the order `search` returns hits in, which also merges the hits of several indexes
+        static bool better(const hit& a, const hit& b);
+        size_t size() const { return m_docs.size(); }
+
+        // the set the index was built from, if any; indexes read from disk have none
+        void set_source(nix::RootValue source) { m_source = std::move(source); }
+        bool indexes(const nix::Value& v) const;
+
+        // the index is stored together with `key`, and only loads under the same key
+        // neither throws, a missing or unreadable file just means no index
+        bool save(const std::filesystem::path& file, const std::string& key) const;
+        static std::unique_ptr<doc_search_index> load(const std::filesystem::path& file, const std::string& key);
+
+    private:
+        struct document
+        {
+            std::string name;
+            // the first line of the documentation
+            std::string summary;
+        };
+
+        struct posting
+        {
+            uint32_t doc;
+            uint32_t frequency;
+        };
+
+        void add_terms(uint32_t doc, const std::unordered_map<std::string, uint32_t>& terms);
+
+        std::vector<document> m_docs;
+        std::unordered_map<std::string, std::vector<posting>> m_postings;
+        nix::RootValue m_source;
+    };
+}
+
+#endif
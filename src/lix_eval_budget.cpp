@@ -0,0 +1,33 @@
+#include "lix_eval_budget.hpp"
+
+#include "lix/libutil/signals.hh"
+
+namespace xeus_lix
+{
+    eval_budget::eval_budget(std::chrono::milliseconds budget)
+        : m_deadline(std::chrono::steady_clock::now() + budget)
+        , m_previous_check(nix::interruptCheck)
+    {
+        nix::interruptCheck = [this] {
+            if (m_previous_check && m_previous_check())
+            {
+                return true;
+            }
+            return ++m_checks % CLOCK_CHECK_INTERVAL == 0 ? expired() : m_expired;
+        };
+    }
+
+    eval_budget::~eval_budget()
+    {
+        nix::interruptCheck = std::move(m_previous_check);
+    }
+
+    bool eval_budget::expired() const
+    {
+        if (!m_expired && std::chrono::steady_clock::now() >= m_deadline)
+        {
+            m_expired = true;
+        }
+        return m_expired;
+    }
+}
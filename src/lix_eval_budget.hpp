@@ -0,0 +1,40 @@
+#ifndef XEUS_LIX_EVAL_BUDGET_HPP
+#define XEUS_LIX_EVAL_BUDGET_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+namespace xeus_lix
+{
+    // bounds the time spent evaluating on the current thread while it is alive
+    // evaluation only stops at interrupt checks, so the budget installs its own source
+    // of interrupts there: once the deadline has passed, nix::checkInterrupt() throws
+    // nix::Interrupted without lix's interrupt flag ever being set. code forcing values
+    // under a budget catches nix::Interrupted and asks `expired()` whether it was the
+    // budget; a real interrupt raised meanwhile stays pending and is seen by the next
+    // check. forcing a thunk that gets interrupted leaves it a thunk, so nothing is lost
+    class eval_budget
+    {
+    public:
+        explicit eval_budget(std::chrono::milliseconds budget);
+        // puts back the interrupt check that was there before
+        ~eval_budget();
+
+        eval_budget(const eval_budget&) = delete;
+        eval_budget& operator=(const eval_budget&) = delete;
+
+        bool expired() const;
+
+    private:
+        // the clock is read on every CLOCK_CHECK_INTERVAL-th interrupt check only
+        static constexpr uint32_t CLOCK_CHECK_INTERVAL = 64;
+
+        std::chrono::steady_clock::time_point m_deadline;
+        mutable bool m_expired = false;
+        uint32_t m_checks = 0;
+        std::function<bool()> m_previous_check;
+    };
+}
+
+#endif
@@ -1,15 +1,32 @@
 #include "lix_interpreter.hpp"
+#include "lix_attr_cache.hpp"
+#include "lix_attr_index.hpp"
+#include "lix_doc_cache.hpp"
+#include "lix_doc_index.hpp"
+#include "lix_eval_budget.hpp"
+#include "lix_flake_cache.hpp"
+#include "lix_lexer.hpp"
+#include "lix_parse_cache.hpp"
+#include "lix_repl_scope.hpp"
+#include "lix_shell_runner.hpp"
+#include "lix_symbol_index.hpp"
+#include "lix_value_printer.hpp"
 
-#include <array>
-#include <cstdio>
+#include <algorithm>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <string_view>
 
 #include "lix/libcmd/markdown.hh"
 #include "lix/libexpr/eval.hh"
+#include "lix/libexpr/get-drvs.hh"
+#include "lix/libstore/store-api.hh"
 #include "lix/libutil/ansicolor.hh"
 #include "lix/libutil/canon-path.hh"
 #include "lix/libutil/error.hh"
+#include "lix/libutil/signals.hh"
 #include "lix/libutil/strings.hh"
 
 // forward declarations for lix-doc functionality
@@ -60,26 +77,18 @@ namespace xeus_lix
             return;
         }
 
-        // redirect stderr to stdout to capture all output in the cell
-        cmd_to_run += " 2>&1";
-
-        std::array<char, 128> buffer;
-        std::string result;
-
-        std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(cmd_to_run.c_str(), "r"), pclose);
-        if (!pipe)
-        {
-            publish_stream("stderr", "popen() failed!\n");
-            return;
-        }
-        while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr)
+        auto status = run_shell_script(
+            cmd_to_run,
+            [this](const std::string& name, const std::string& text) { publish_stream(name, text); },
+            *m_cancel
+        );
+        if (status.signal != 0)
         {
-            result += buffer.data();
+            publish_stream("stderr", "command killed by signal " + std::to_string(status.signal) + "\n");
         }
-
-        if (!result.empty())
+        else if (status.exit_code != 0)
         {
-            publish_stream("stdout", result);
+            publish_stream("stderr", "command exited with status " + std::to_string(status.exit_code) + "\n");
         }
     }
 
@@ -89,21 +98,46 @@ namespace xeus_lix
         {
             return;
         }
-        if (m_displacement + bindings.size() > NIX_ENV_SIZE)
-        {
-            throw std::runtime_error("Nix environment scope overflow. Cannot add more variables.");
-        }
-        // add each attribute to the static environment (for name lookup) and place its value in the local environment array
+        // bind each attribute in the scope, which grows as needed
+        std::vector<std::string_view> names;
+        names.reserve(bindings.size());
         for (auto& attr : bindings)
         {
-            m_staticEnv->vars.insert_or_assign(attr.name, m_displacement);
-            m_localEnv->values[m_displacement++] = attr.value;
+            m_scope->bind(attr.name, attr.value);
+            names.push_back(m_evaluator->symbols[attr.name]);
         }
+        ++m_scope_generation;
+        std::unique_lock names_lock(m_names_mutex);
+        m_symbol_index->add(std::move(names));
+        m_attr_cache->invalidate_roots([&](std::string_view root) {
+            return bindings.get(m_evaluator->symbols.create(root)) != nullptr;
+        });
+        names_lock.unlock();
         std::stringstream ss;
         ss << "Added " << bindings.size() << " variables.\n";
         publish_stream("stdout", ss.str());
     }
 
+    std::shared_ptr<parsed_input> interpreter::parse_repl_input(std::string_view code)
+    {
+        // trailing whitespace does not change the parse (or any position in it), so it is
+        // dropped to let a cell checked by is_complete_request hit the cache on execution
+        code = code.substr(0, code.find_last_not_of(" \t\r\n") + 1);
+
+        if (auto cached = m_parse_cache->find(code, m_scope_generation))
+        {
+            ++m_stats.parse_cache_hits;
+            return cached;
+        }
+        ++m_stats.parse_cache_misses;
+        ++m_stats.parses;
+        auto parsed = std::make_shared<parsed_input>(
+            m_evaluator->parseReplInput(std::string(code), nix::CanonPath::fromCwd(), m_scope->static_env())
+        );
+        m_parse_cache->insert(std::string(code), m_scope_generation, parsed);
+        return parsed;
+    }
+
     void interpreter::eval_pure_expression(const std::string_view expr_str, nix::Value& result)
     {
         if (nix::trim(expr_str).empty())
@@ -112,17 +146,447 @@ namespace xeus_lix
             return;
         }
         // parse and evaluate the expression within the current environment
-        auto& expr = m_evaluator->parseExprFromString(std::string(expr_str), nix::CanonPath::fromCwd(), m_staticEnv);
-        expr.eval(*m_evalState, *m_localEnv, result);
+        auto parsed = parse_repl_input(expr_str);
+        auto expr = std::get_if<std::unique_ptr<nix::Expr>>(&parsed->result);
+        if (!expr)
+        {
+            throw nix::Error("'%s' is a binding, not an expression", std::string(expr_str));
+        }
+        parsed->evaluated = true;
+        (*expr)->eval(*m_evalState, m_scope->env(), result);
         // force the result to a weak head normal form
         m_evalState->forceValue(result, nix::noPos);
     }
 
-    std::string interpreter::get_doc_string(const nix::Value& v) const
+    const attr_listing* interpreter::lookup_attr_names(const std::string& path)
+    {
+        if (auto cached = m_attr_cache->find(path))
+        {
+            ++m_stats.attr_cache_hits;
+            return cached;
+        }
+        ++m_stats.attr_cache_misses;
+
+        nix::Value* v = nullptr;
+        size_t last_dot_pos = path.rfind('.');
+        if (last_dot_pos != std::string::npos)
+        {
+            // walk one attribute down from the (cached) parent instead of evaluating the whole path
+            auto parent = lookup_attr_names(path.substr(0, last_dot_pos));
+            if (!parent)
+            {
+                return nullptr;
+            }
+            auto attr = (*parent->value)->attrs->get(m_evaluator->symbols.create(path.substr(last_dot_pos + 1)));
+            if (!attr)
+            {
+                return nullptr;
+            }
+            v = attr->value;
+            m_evalState->forceValue(*v, attr->pos);
+        }
+        else
+        {
+            v = m_evaluator->mem.allocValue();
+            eval_pure_expression(path, *v);
+        }
+
+        if (v->type() != nix::nAttrs)
+        {
+            return nullptr;
+        }
+
+        std::vector<std::string_view> names;
+        names.reserve(v->attrs->size());
+        for (const auto& attr : *v->attrs)
+        {
+            names.push_back(m_evaluator->symbols[attr.name]);
+        }
+        std::sort(names.begin(), names.end());
+        attr_listing listing{ .value = nix::allocRootValue(v), .names = name_list(std::move(names)) };
+        std::unique_lock names_lock(m_names_mutex);
+        return &m_attr_cache->insert(path, std::move(listing));
+    }
+
+    const name_list* interpreter::cached_completion_names(const std::string& path) const
+    {
+        if (auto listing = m_attr_cache->find(path))
+        {
+            return &listing->names;
+        }
+        // while a session is replayed, what an earlier one indexed stands in for the source;
+        // its index was read before the replay started, so finding in it changes nothing
+        auto origin = m_replay_origins.find(attr_name_cache::root_of(path));
+        return origin == m_replay_origins.end() ? nullptr : m_attr_index->find(*origin->second, path);
+    }
+
+    const name_list* interpreter::lookup_completion_names(const std::string& path)
+    {
+        // flake outputs are listed from the evaluation cache, which outlives the session
+        std::vector<nix::Symbol> attr_path;
+        if (auto flake = flake_attr_path(path, attr_path))
+        {
+            return flake->attr_names(*m_evalState, attr_path);
+        }
+
+        // a path below a loaded store source may have been listed by an earlier session
+        const std::string* origin = source_origin(attr_name_cache::root_of(path));
+        if (origin && !m_attr_cache->find(path))
+        {
+            // the shell thread reads the index while a session is replayed
+            std::unique_lock names_lock(m_names_mutex);
+            if (auto names = m_attr_index->find(*origin, path))
+            {
+                ++m_stats.attr_index_hits;
+                return names;
+            }
+        }
+
+        auto listing = lookup_attr_names(path);
+        if (!listing)
+        {
+            return nullptr;
+        }
+        if (origin)
+        {
+            std::unique_lock names_lock(m_names_mutex);
+            m_attr_index->record(*origin, path, listing->names.names);
+        }
+        return &listing->names;
+    }
+
+    const std::string* interpreter::source_origin(std::string_view name)
+    {
+        auto symbol = m_evaluator->symbols.create(name);
+        // the name must still be bound to the source's own attribute, not rebound since
+        nix::Value* bound = m_scope->lookup(symbol);
+        if (!bound)
+        {
+            return nullptr;
+        }
+        for (auto it = m_loaded_sources.rbegin(); it != m_loaded_sources.rend(); ++it)
+        {
+            auto attr = (*it->value)->attrs->get(symbol);
+            if (attr && attr->value == bound)
+            {
+                return &it->origin;
+            }
+        }
+        return nullptr;
+    }
+
+    // the flake whose outputs the dotted `path` lies below, and the attribute path to it there
+    flake_output_cache* interpreter::flake_attr_path(const std::string& path, std::vector<nix::Symbol>& attr_path)
+    {
+        if (m_flakes.empty() || !is_attr_path(path))
+        {
+            return nullptr;
+        }
+        auto root = m_evaluator->symbols.create(attr_name_cache::root_of(path));
+        nix::Value* bound = m_scope->lookup(root);
+        if (!bound)
+        {
+            return nullptr;
+        }
+        for (auto it = m_flakes.rbegin(); it != m_flakes.rend(); ++it)
+        {
+            auto prefix = (*it)->attr_path_of(root, bound);
+            if (!prefix)
+            {
+                continue;
+            }
+            attr_path = std::move(*prefix);
+            std::string_view rest = path;
+            for (size_t dot = rest.find('.'); dot != std::string_view::npos; dot = rest.find('.'))
+            {
+                rest.remove_prefix(dot + 1);
+                attr_path.push_back(m_evaluator->symbols.create(rest.substr(0, rest.find('.'))));
+            }
+            return it->get();
+        }
+        return nullptr;
+    }
+
+    const doc_search_index& interpreter::builtins_doc_index()
+    {
+        if (m_builtins_docs)
+        {
+            return *m_builtins_docs;
+        }
+        // the builtins are primops, so looking at their docs forces nothing
+        m_builtins_docs = std::make_unique<doc_search_index>();
+        std::set<std::string_view> seen;
+        for (const auto& [symbol, displ] : m_evaluator->builtins.staticEnv->vars)
+        {
+            std::string_view name = m_evaluator->symbols[symbol];
+            if (name.starts_with("__"))
+            {
+                name.remove_prefix(2);
+            }
+            if (!seen.insert(name).second)
+            {
+                continue;
+            }
+            if (auto doc = m_evaluator->builtins.getDoc(*m_evaluator->builtins.env.values[displ]))
+            {
+                std::string text = nix::concatStringsSep(" ", doc->args) + "\n" + nix::stripIndentation(doc->doc);
+                m_builtins_docs->add("builtins." + std::string(name), text);
+            }
+        }
+        return *m_builtins_docs;
+    }
+
+    const doc_search_index& interpreter::lambda_doc_index(const std::string& expr_str, nix::Value& v)
+    {
+        auto& index = m_doc_indexes[expr_str];
+        if (index && index->indexes(v))
+        {
+            return *index;
+        }
+
+        auto root = m_evaluator->mem.allocValue();
+        *root = v;
+
+        // a set below a store source has the same docs in every session, so it is cached on disk
+        std::string key;
+        if (is_attr_path(expr_str))
+        {
+            if (auto origin = source_origin(attr_name_cache::root_of(expr_str)))
+            {
+                key = *origin + "#" + expr_str;
+            }
+        }
+        auto file = cache_directory() / "apropos" / cache_file_name(key, ".idx");
+        if (!key.empty())
+        {
+            if (auto loaded = doc_search_index::load(file, key))
+            {
+                index = std::move(loaded);
+                index->set_source(nix::allocRootValue(root));
+                return *index;
+            }
+        }
+
+        index = std::make_unique<doc_search_index>();
+        index->set_source(nix::allocRootValue(root));
+
+        // breadth first, so a function re-exported higher up (`lib.concatStrings` for
+        // `lib.strings.concatStrings`) is listed under its shortest path
+        struct pending
+        {
+            nix::Value* set;
+            std::string path;
+            unsigned depth;
+        };
+        std::deque<pending> queue{ { root, expr_str, 0 } };
+        std::set<const nix::ExprLambda*> seen;
+        while (!queue.empty())
+        {
+            pending current = std::move(queue.front());
+            queue.pop_front();
+            for (const auto& attr : *current.set->attrs)
+            {
+                nix::checkInterrupt();
+                std::string attr_path = current.path + "." + std::string(m_evaluator->symbols[attr.name]);
+                try
+                {
+                    nix::Value& attr_value = *attr.value;
+                    m_evalState->forceValue(attr_value, attr.pos);
+                    if (attr_value.isLambda())
+                    {
+                        if (seen.insert(attr_value.lambda.fun).second)
+                        {
+                            if (auto doc = get_doc_string(attr_value); !doc.empty())
+                            {
+                                index->add(std::move(attr_path), doc);
+                            }
+                        }
+                    }
+                    else if (attr_value.type() == nix::nAttrs && current.depth + 1 < APROPOS_MAX_DEPTH
+                             && !m_evalState->isDerivation(attr_value))
+                    {
+                        queue.push_back({ &attr_value, std::move(attr_path), current.depth + 1 });
+                    }
+                }
+                catch (const nix::Error&)
+                {
+                    // deprecated aliases throw when forced, they have no docs anyway
+                }
+            }
+        }
+
+        if (!key.empty())
+        {
+            index->save(file, key);
+        }
+        return *index;
+    }
+
+    std::string interpreter::describe_attr_path(const std::string& path, int detail_level)
+    {
+        eval_budget budget(INSPECT_TIME_BUDGET);
+        // runs `f` unless the budget has run out, and reports whether it completed
+        auto within_budget = [&](auto&& f) {
+            if (budget.expired())
+            {
+                return false;
+            }
+            try
+            {
+                f();
+                return true;
+            }
+            catch (const nix::Interrupted&)
+            {
+                if (budget.expired())
+                {
+                    return false;
+                }
+                throw;
+            }
+        };
+        // at most weak head normal form, never deeper
+        auto force = [&](nix::Value& v, nix::PosIdx pos) {
+            return v.type() != nix::nThunk || within_budget([&] { m_evalState->forceValue(v, pos); });
+        };
+        auto show_pos = [&](nix::PosIdx pos) {
+            std::stringstream ss;
+            ss << m_evaluator->positions[pos];
+            return ss.str();
+        };
+
+        std::vector<std::string> parts = nix::tokenizeString<std::vector<std::string>>(path, ".");
+        auto root = m_evaluator->symbols.create(parts.front());
+        nix::Value* v = nullptr;
+        if (auto bound = m_scope->lookup(root))
+        {
+            v = bound;
+        }
+        else if (auto builtin = m_evaluator->builtins.staticEnv->find(root); builtin != m_evaluator->builtins.staticEnv->vars.end())
+        {
+            v = m_evaluator->builtins.env.values[builtin->second];
+        }
+        if (!v)
+        {
+            return "";
+        }
+
+        // walk down without forcing anything but the sets along the path
+        nix::PosIdx def_pos = nix::noPos;
+        for (size_t i = 1; i < parts.size(); ++i)
+        {
+            if (!force(*v, def_pos))
+            {
+                auto prefix = nix::concatStringsSep(".", std::vector<std::string>(parts.begin(), parts.begin() + i));
+                return "`" + prefix + "` is an unevaluated thunk (evaluation budget exceeded)";
+            }
+            if (v->type() != nix::nAttrs)
+            {
+                return "";
+            }
+            auto attr = v->attrs->get(m_evaluator->symbols.create(parts[i]));
+            if (!attr)
+            {
+                return "";
+            }
+            v = attr->value;
+            def_pos = attr->pos;
+        }
+
+        std::stringstream md;
+        bool evaluated = force(*v, def_pos);
+        md << "`" << path << "`: " << (evaluated ? nix::showType(*v) : "an unevaluated thunk (evaluation budget exceeded)");
+
+        if (evaluated && v->type() == nix::nAttrs)
+        {
+            md << " with " << v->attrs->size() << " attributes";
+            std::optional<nix::DrvInfo> drv;
+            within_budget([&] { drv = nix::getDerivation(*m_evalState, *v, true); });
+            if (drv)
+            {
+                std::string name;
+                if (within_budget([&] { name = drv->queryName(*m_evalState); }))
+                {
+                    md << "\n\nderivation `" << name << "`";
+                }
+                // instantiating the derivation can be expensive, so only on request
+                std::optional<nix::StorePath> drv_path;
+                if (detail_level > 0 && within_budget([&] { drv_path = drv->queryDrvPath(*m_evalState); }) && drv_path)
+                {
+                    md << "\n\ndrvPath: `" << m_store->printStorePath(*drv_path) << "`";
+                }
+            }
+            else if (detail_level > 0)
+            {
+                std::vector<std::string_view> names;
+                for (const auto& attr : *v->attrs)
+                {
+                    names.push_back(m_evaluator->symbols[attr.name]);
+                }
+                std::sort(names.begin(), names.end());
+                md << "\n\nattributes: ";
+                for (size_t i = 0; i < std::min<size_t>(names.size(), 50); ++i)
+                {
+                    md << (i == 0 ? "" : ", ") << "`" << names[i] << "`";
+                }
+                if (names.size() > 50)
+                {
+                    md << ", ...";
+                }
+            }
+        }
+        else if (evaluated && v->type() == nix::nList)
+        {
+            md << " of " << v->listSize() << " elements";
+        }
+
+        if (def_pos == nix::noPos && evaluated && v->isLambda())
+        {
+            def_pos = v->lambda.fun->pos;
+        }
+        if (def_pos != nix::noPos)
+        {
+            md << "\n\ndefined at " << show_pos(def_pos);
+        }
+
+        if (evaluated)
+        {
+            if (auto doc = get_doc_string(*v); !doc.empty())
+            {
+                md << "\n\n" << doc;
+            }
+        }
+        return md.str();
+    }
+
+    // prints `v` within `limits`; if it does not all fit, `:p --more` prints the rest
+    std::string interpreter::print_value(const nix::Value& v, const print_limits& limits)
+    {
+        // the printer outlives the cell, so it needs a copy of a value on the stack
+        nix::Value* value = m_evaluator->mem.allocValue();
+        *value = v;
+        m_print_continuation.reset();
+        auto printer = std::make_unique<value_printer>(*m_evaluator, *value, limits);
+        std::string out;
+        if (!printer->print(*m_evalState, out))
+        {
+            m_print_continuation = std::move(printer);
+        }
+        return out;
+    }
+
+    std::string interpreter::get_doc_string(const nix::Value& v)
     {
         // check for builtin function documentation
         if (auto doc = m_evaluator->builtins.getDoc(const_cast<nix::Value&>(v)))
         {
+            // partial applications of a primop document fewer arguments
+            std::string key = doc->name ? *doc->name + "/" + std::to_string(doc->args.size()) : "";
+            if (auto cached = m_builtin_doc_markdown.find(key); !key.empty() && cached != m_builtin_doc_markdown.end())
+            {
+                return cached->second;
+            }
+
             std::stringstream markdown_stream;
 
             if (doc->name)
@@ -136,7 +600,11 @@ namespace xeus_lix
             }
 
             markdown_stream << nix::stripIndentation(doc->doc);
-            return markdown_stream.str();
+            if (key.empty())
+            {
+                return markdown_stream.str();
+            }
+            return m_builtin_doc_markdown.emplace(std::move(key), markdown_stream.str()).first->second;
         }
         // try to get the documentation comment if it's a lambda with a source position
         else if (v.isLambda() && v.lambda.fun->pos != nix::noPos)
@@ -144,11 +612,11 @@ namespace xeus_lix
             auto pos = m_evaluator->positions[v.lambda.fun->pos];
             if (auto path = std::get_if<nix::CheckedSourcePath>(&pos.origin))
             {
-                auto docComment = lambdaDocsForPos(*path, pos);
-                if (docComment)
-                {
-                    return nix::stripIndentation(docComment.get());
-                }
+                std::string file = path->to_string();
+                return m_doc_cache->get(file, m_store->isInStore(file), pos.line, pos.column, [&] {
+                    auto docComment = lambdaDocsForPos(*path, pos);
+                    return docComment ? nix::stripIndentation(docComment.get()) : std::string();
+                });
             }
         }
         // no documentation was found
@@ -0,0 +1,116 @@
+#include "lix_eval_worker.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#define GC_THREADS
+#include <gc/gc.h>
+
+namespace xeus_lix
+{
+    eval_worker::eval_worker(size_t stack_size)
+    {
+        // values live on the worker's stack, so the collector has to scan it
+        GC_allow_register_threads();
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, stack_size);
+        int err = pthread_create(&m_thread, &attr, &eval_worker::run, this);
+        pthread_attr_destroy(&attr);
+        if (err != 0)
+        {
+            throw std::runtime_error("cannot start the evaluation thread: " + std::string(std::strerror(err)));
+        }
+    }
+
+    eval_worker::~eval_worker()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_one();
+        pthread_join(m_thread, nullptr);
+    }
+
+    void eval_worker::post(std::function<void()> job)
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_jobs.push_back(std::move(job));
+        }
+        m_wake.notify_one();
+    }
+
+    bool eval_worker::post_if_idle(std::function<void()> job)
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_running_job || !m_jobs.empty())
+            {
+                return false;
+            }
+            m_jobs.push_back(std::move(job));
+        }
+        m_wake.notify_one();
+        return true;
+    }
+
+    void eval_worker::set_idle_task(std::function<bool()> task)
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_idle_task = std::move(task);
+        }
+        m_wake.notify_one();
+    }
+
+    bool eval_worker::on_worker_thread() const
+    {
+        return pthread_equal(pthread_self(), m_thread);
+    }
+
+    void* eval_worker::run(void* self)
+    {
+        GC_stack_base stack;
+        GC_get_stack_base(&stack);
+        GC_register_my_thread(&stack);
+        static_cast<eval_worker*>(self)->loop();
+        GC_unregister_my_thread();
+        return nullptr;
+    }
+
+    void eval_worker::loop()
+    {
+        std::unique_lock lock(m_mutex);
+        bool idle_work = true;
+        while (true)
+        {
+            if (m_jobs.empty() && !m_stopping && m_idle_task && idle_work)
+            {
+                // not counted as a job: `try_call` only waits for the task's next return
+                auto task = m_idle_task;
+                lock.unlock();
+                idle_work = task();
+                lock.lock();
+                continue;
+            }
+            m_wake.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+            idle_work = true;
+            if (m_jobs.empty())
+            {
+                return;
+            }
+            auto job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+            m_running_job = true;
+            lock.unlock();
+            // jobs report their own errors; `call` carries them back through its future
+            job();
+            lock.lock();
+            m_running_job = false;
+        }
+    }
+}
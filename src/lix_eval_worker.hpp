@@ -0,0 +1,80 @@
+#ifndef XEUS_LIX_EVAL_WORKER_HPP
+#define XEUS_LIX_EVAL_WORKER_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <pthread.h>
+#include <type_traits>
+
+namespace xeus_lix
+{
+    // the stack the evaluation thread gets unless `--eval-stack-size` says otherwise
+    // evaluating nixpkgs recurses deeply, the same size lix gives its own main thread
+    inline constexpr size_t DEFAULT_EVAL_STACK_SIZE = size_t(64) << 20;
+
+    // the thread that owns the lix evaluator: the event loop, the store connection and
+    // every value are bound to it, so all evaluation runs here, one job at a time and in
+    // the order the jobs were posted. other threads hand work over and keep answering
+    class eval_worker
+    {
+    public:
+        explicit eval_worker(size_t stack_size = DEFAULT_EVAL_STACK_SIZE);
+        // runs the jobs still queued, then stops the thread
+        ~eval_worker();
+
+        eval_worker(const eval_worker&) = delete;
+        eval_worker& operator=(const eval_worker&) = delete;
+
+        void post(std::function<void()> job);
+
+        // runs `f` on the worker and waits for it, exceptions are rethrown here
+        template<typename F>
+        std::invoke_result_t<F> call(F&& f)
+        {
+            std::packaged_task<std::invoke_result_t<F>()> task(std::forward<F>(f));
+            auto result = task.get_future();
+            post([&task] { task(); });
+            return result.get();
+        }
+
+        // like `call`, but only if the worker has nothing to do; never waits behind a job
+        template<typename F>
+        std::optional<std::invoke_result_t<F>> try_call(F&& f)
+        {
+            std::packaged_task<std::invoke_result_t<F>()> task(std::forward<F>(f));
+            auto result = task.get_future();
+            if (!post_if_idle([&task] { task(); }))
+            {
+                return std::nullopt;
+            }
+            return result.get();
+        }
+
+        bool on_worker_thread() const;
+
+        // called on the worker whenever it runs out of jobs, for work that progresses in
+        // the background (the event loop only runs while someone waits on it). the task
+        // should return after a short while, and false once there is nothing left to do
+        void set_idle_task(std::function<bool()> task);
+
+    private:
+        static void* run(void* self);
+        void loop();
+        bool post_if_idle(std::function<void()> job);
+
+        pthread_t m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::deque<std::function<void()>> m_jobs;
+        std::function<bool()> m_idle_task;
+        bool m_running_job = false;
+        bool m_stopping = false;
+    };
+}
+
+#endif
@@ -0,0 +1,286 @@
+#include "lix_file_watch.hpp"
+#include "lix_lexer.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace xeus_lix
+{
+    namespace
+    {
+        // what happens to a file when an editor saves it, in place or by renaming a new one over it
+        constexpr uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE
+            | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+        std::string read_file(const std::filesystem::path& path)
+        {
+            std::ifstream in(path, std::ios::binary);
+            std::stringstream contents;
+            contents << in.rdbuf();
+            return contents.str();
+        }
+
+        std::vector<std::string> directory_listing(const std::filesystem::path& dir)
+        {
+            std::vector<std::string> names;
+            std::error_code ec;
+            for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+            {
+                names.push_back(it->path().filename().string());
+            }
+            std::sort(names.begin(), names.end());
+            return names;
+        }
+
+        // a directory hashes its listing; a missing file hashes like an empty one, which
+        // tells it apart from any file with contents
+        uint64_t content_hash(const std::string& path)
+        {
+            std::error_code ec;
+            auto status = std::filesystem::status(path, ec);
+            std::string contents;
+            if (std::filesystem::is_directory(status))
+            {
+                contents = "directory\n";
+                for (const auto& name : directory_listing(path))
+                {
+                    contents += name;
+                    contents += '\n';
+                }
+            }
+            else if (std::filesystem::is_regular_file(status))
+            {
+                contents = "file\n" + read_file(path);
+            }
+            return std::hash<std::string>{}(contents);
+        }
+
+        // where a path literal found in a file in `base` points to; empty for `<nixpkgs>`
+        std::filesystem::path resolve_path_literal(std::string_view text, const std::filesystem::path& base)
+        {
+            if (text.starts_with('<'))
+            {
+                return {};
+            }
+            std::filesystem::path path;
+            if (text.starts_with("~/"))
+            {
+                const char* home = std::getenv("HOME");
+                if (!home || !*home)
+                {
+                    return {};
+                }
+                path = std::filesystem::path(home) / text.substr(2);
+            }
+            else if (text.starts_with('/'))
+            {
+                path = std::filesystem::path(text);
+            }
+            else
+            {
+                path = base / text;
+            }
+            return path.lexically_normal();
+        }
+    }
+
+    bool source_dependencies(
+        const std::filesystem::path& file,
+        const std::function<bool(const std::string&)>& skip,
+        size_t limit,
+        std::vector<std::string>& out
+    )
+    {
+        std::set<std::string> seen;
+        std::vector<std::filesystem::path> pending{ file };
+        while (!pending.empty())
+        {
+            std::error_code ec;
+            std::filesystem::path path = std::filesystem::weakly_canonical(pending.back(), ec);
+            if (ec)
+            {
+                path = pending.back().lexically_normal();
+            }
+            pending.pop_back();
+
+            // the loaded file is read whatever it is called
+            bool is_root = seen.empty();
+            std::string name = path.string();
+            if (!seen.insert(name).second || skip(name))
+            {
+                continue;
+            }
+            if (out.size() >= limit)
+            {
+                return false;
+            }
+            out.push_back(name);
+
+            auto status = std::filesystem::status(path, ec);
+            if (std::filesystem::is_directory(status))
+            {
+                for (const auto& entry : directory_listing(path))
+                {
+                    if (entry.ends_with(".nix"))
+                    {
+                        pending.push_back(path / entry);
+                    }
+                }
+                continue;
+            }
+            // a missing file is still a dependency: creating it changes what is read
+            if (!std::filesystem::is_regular_file(status) || (!is_root && path.extension() != ".nix"))
+            {
+                continue;
+            }
+
+            std::string source = read_file(path);
+            lexer lex(source);
+            for (token tok = lex.next(); tok.kind != token_kind::eof; tok = lex.next())
+            {
+                if (tok.kind != token_kind::path)
+                {
+                    continue;
+                }
+                if (auto target = resolve_path_literal(tok.text, path.parent_path()); !target.empty())
+                {
+                    pending.push_back(std::move(target));
+                }
+            }
+        }
+        return true;
+    }
+
+    file_watch::file_watch()
+        : m_fd(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+    {
+    }
+
+    file_watch::~file_watch()
+    {
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+        }
+    }
+
+    void file_watch::track(const std::string& path)
+    {
+        m_hashes[path] = content_hash(path);
+        m_unwatched.erase(path);
+
+        std::filesystem::path fs_path(path);
+        bool watched = fs_path.has_parent_path() && watch_directory(fs_path.parent_path().string());
+        // a file created inside a tracked directory only shows up in the directory's own watch
+        std::error_code ec;
+        if (std::filesystem::is_directory(fs_path, ec))
+        {
+            watched = watch_directory(path) && watched;
+        }
+        if (!watched)
+        {
+            m_unwatched.insert(path);
+        }
+    }
+
+    bool file_watch::watch_directory(const std::string& dir)
+    {
+        if (m_watched_dirs.contains(dir))
+        {
+            return true;
+        }
+        if (m_fd < 0)
+        {
+            return false;
+        }
+        int wd = ::inotify_add_watch(m_fd, dir.c_str(), WATCH_MASK | IN_ONLYDIR);
+        if (wd < 0)
+        {
+            return false;
+        }
+        m_watches[wd] = dir;
+        m_watched_dirs[dir] = wd;
+        return true;
+    }
+
+    void file_watch::drain_events(std::set<std::string>& candidates)
+    {
+        if (m_fd < 0)
+        {
+            return;
+        }
+        alignas(inotify_event) char buffer[16 * 1024];
+        ssize_t n;
+        while ((n = ::read(m_fd, buffer, sizeof(buffer))) > 0)
+        {
+            for (char* p = buffer; p < buffer + n;)
+            {
+                const auto* event = reinterpret_cast<const inotify_event*>(p);
+                p += sizeof(inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    // events were lost, so anything may have changed
+                    for (const auto& [path, hash] : m_hashes)
+                    {
+                        candidates.insert(path);
+                    }
+                    continue;
+                }
+                auto it = m_watches.find(event->wd);
+                if (it == m_watches.end())
+                {
+                    continue;
+                }
+                const std::string& dir = it->second;
+                candidates.insert(dir);
+                if (event->len > 0)
+                {
+                    candidates.insert((std::filesystem::path(dir) / event->name).string());
+                }
+                if (event->mask & IN_IGNORED)
+                {
+                    // the directory is gone or was moved; what was tracked in it is hashed
+                    // on every call from now on
+                    for (const auto& [path, hash] : m_hashes)
+                    {
+                        if (path == dir || std::filesystem::path(path).parent_path() == dir)
+                        {
+                            m_unwatched.insert(path);
+                        }
+                    }
+                    m_watched_dirs.erase(dir);
+                    m_watches.erase(it);
+                }
+            }
+        }
+    }
+
+    std::set<std::string> file_watch::changed()
+    {
+        std::set<std::string> candidates = m_unwatched;
+        drain_events(candidates);
+
+        std::set<std::string> changed;
+        for (const auto& path : candidates)
+        {
+            auto it = m_hashes.find(path);
+            if (it == m_hashes.end())
+            {
+                continue;
+            }
+            uint64_t hash = content_hash(path);
+            if (hash != it->second)
+            {
+                it->second = hash;
+                changed.insert(path);
+            }
+        }
+        return changed;
+    }
+}
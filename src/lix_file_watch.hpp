@@ -0,0 +1,83 @@
+#ifndef XEUS_LIX_FILE_WATCH_HPP
+#define XEUS_LIX_FILE_WATCH_HPP
+
+#include "lix/libexpr/eval.hh"
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace xeus_lix
+{
+    // a file brought into scope with `:load`
+    struct loaded_file
+    {
+        // as given to lookupFileArg on reload
+        std::string path;
+        // the local files its evaluation may have read, see source_dependencies
+        std::vector<std::string> dependencies;
+        // false if there were too many to track, so it is evaluated again on every reload
+        bool complete = false;
+        // the attribute set it evaluated to, empty if the last attempt failed
+        nix::RootValue value;
+    };
+
+    // the local files evaluating `file` may read: the file itself and whatever its path
+    // literals name, followed through the nix files among them
+    // lix does not report which files an evaluation opened, so this is a static
+    // over-approximation. a path literal that names a directory (`./modules`, or the
+    // `./dir` of `./dir + "/${name}.nix"`) stands for its listing and the nix files right
+    // in it. paths for which `skip` holds, such as store paths, are not followed.
+    // returns false once more than `limit` files were found, leaving `out` incomplete
+    bool source_dependencies(
+        const std::filesystem::path& file,
+        const std::function<bool(const std::string&)>& skip,
+        size_t limit,
+        std::vector<std::string>& out
+    );
+
+    // content hashes of tracked files, and which of them changed since
+    // the directory of every tracked file is watched with inotify, so `changed()` only
+    // reads again the files something happened to. where inotify is unavailable or a
+    // watch cannot be added, those files are hashed on every call instead
+    class file_watch
+    {
+    public:
+        file_watch();
+        ~file_watch();
+
+        file_watch(const file_watch&) = delete;
+        file_watch& operator=(const file_watch&) = delete;
+
+        // records what `path` contains now and starts watching it
+        void track(const std::string& path);
+        // the tracked files whose contents differ from what was recorded, which is then
+        // updated, so each change is reported once
+        std::set<std::string> changed();
+
+        size_t tracked() const { return m_hashes.size(); }
+        size_t watches() const { return m_watches.size(); }
+
+    private:
+        bool watch_directory(const std::string& dir);
+        void drain_events(std::set<std::string>& candidates);
+
+        int m_fd;
+        std::map<std::string, uint64_t> m_hashes;
+        // watch descriptor to the directory it watches, and back
+        std::map<int, std::string> m_watches;
+        std::map<std::string, int> m_watched_dirs;
+        // files whose directory has no watch
+        std::set<std::string> m_unwatched;
+    };
+
+    // upper bound on the files tracked for one loaded file; a local checkout of nixpkgs
+    // exceeds it and is then simply evaluated again on every reload
+    inline constexpr size_t MAX_TRACKED_DEPENDENCIES = 20000;
+}
+
+#endif
@@ -0,0 +1,193 @@
+#include "lix_flake_cache.hpp"
+#include "lix_attr_index.hpp"
+
+#include <algorithm>
+
+#include "lix/libexpr/eval-error.hh"
+#include "lix/libexpr/eval-settings.hh"
+#include "lix/libstore/globals.hh"
+#include "lix/libutil/hash.hh"
+
+namespace xeus_lix
+{
+    namespace
+    {
+        // call-flake.nix gives back the outputs merged with the flake's source info and
+        // inputs, plus the outputs themselves; forcing the flake forced them already
+        nix::Value* outputs_of(nix::Evaluator& evaluator, nix::Value& flake_value)
+        {
+            auto outputs = flake_value.attrs->get(evaluator.symbols.create("outputs"));
+            if (!outputs || outputs->value->type() != nix::nAttrs)
+            {
+                throw nix::Error("flake has no outputs attribute set");
+            }
+            return outputs->value;
+        }
+
+        // the flake's fingerprint is all that determines a pure evaluation of it; the key
+        // of an impure one must not be a key `nix build` could look up. it covers what an
+        // impure evaluation typically reads and nothing that changes per notebook or launch,
+        // so notebooks on the same flake, and restarted kernels, share the database
+        nix::Hash cache_key(const nix::flake::LockedFlake& flake)
+        {
+            nix::Hash fingerprint = flake.getFingerprint();
+            if (nix::evalSettings.pureEval.get())
+            {
+                return fingerprint;
+            }
+            std::string key = "xeus-lix impure evaluation\n" + fingerprint.to_string(nix::Base::Base16, false) + "\n"
+                + nix::settings.thisSystem.get() + "\n" + nixpkgs_impure_inputs();
+            return nix::hashString(nix::HashType::SHA256, key);
+        }
+    }
+
+    flake_output_cache::flake_output_cache(nix::Evaluator& evaluator, const nix::flake::LockedFlake& flake, nix::Value& flake_value)
+        : m_evaluator(evaluator)
+        , m_fingerprint(cache_key(flake))
+        , m_persistent(nix::evalSettings.useEvalCache.get())
+        , m_flake(nix::allocRootValue(&flake_value))
+        , m_outputs(nix::allocRootValue(outputs_of(evaluator, flake_value)))
+    {
+    }
+
+    std::optional<std::vector<nix::Symbol>> flake_output_cache::attr_path_of(nix::Symbol name, nix::Value* bound) const
+    {
+        auto attr = (*m_flake)->attrs->get(name);
+        if (!attr || attr->value != bound)
+        {
+            return std::nullopt;
+        }
+        if (bound == *m_outputs)
+        {
+            return std::vector<nix::Symbol>{};
+        }
+        // the merge shares the outputs' values, so an output is bound to the very same one
+        auto output = (*m_outputs)->attrs->get(name);
+        if (!output || output->value != bound)
+        {
+            return std::nullopt;
+        }
+        return std::vector<nix::Symbol>{ name };
+    }
+
+    bool flake_output_cache::visit(nix::EvalState& state, const std::vector<nix::Symbol>& attr_path, const visitor& visit)
+    {
+        // the root loader only runs when the cache cannot answer
+        bool evaluated = false;
+        auto cache = nix::make_ref<nix::eval_cache::EvalCache>(
+            m_persistent ? std::optional{ std::cref(m_fingerprint) } : std::nullopt,
+            m_evaluator,
+            [this, &evaluated](nix::EvalState&) {
+                evaluated = true;
+                return *m_outputs;
+            }
+        );
+
+        bool found = false;
+        try
+        {
+            std::shared_ptr<nix::eval_cache::AttrCursor> cursor = cache->getRoot().get_ptr();
+            for (auto name : attr_path)
+            {
+                if (!(cursor = cursor->maybeGetAttr(state, name)))
+                {
+                    break;
+                }
+            }
+            if (cursor)
+            {
+                visit(*cursor);
+                found = true;
+            }
+        }
+        catch (...)
+        {
+            ++(evaluated ? m_misses : m_hits);
+            throw;
+        }
+        ++(evaluated ? m_misses : m_hits);
+        return found;
+    }
+
+    const name_list* flake_output_cache::attr_names(nix::EvalState& state, const std::vector<nix::Symbol>& attr_path)
+    {
+        std::string key;
+        for (auto name : attr_path)
+        {
+            if (!key.empty())
+            {
+                key += '.';
+            }
+            key += m_evaluator.symbols[name];
+        }
+        if (auto it = m_names.find(key); it != m_names.end())
+        {
+            return &it->second;
+        }
+
+        std::optional<std::vector<std::string_view>> names;
+        visit(state, attr_path, [&](nix::eval_cache::AttrCursor& cursor) {
+            try
+            {
+                auto& listed = names.emplace();
+                for (auto name : cursor.getAttrs(state))
+                {
+                    listed.push_back(m_evaluator.symbols[name]);
+                }
+                std::sort(listed.begin(), listed.end());
+            }
+            catch (const nix::TypeError&)
+            {
+                names.reset();
+            }
+        });
+        if (!names)
+        {
+            return nullptr;
+        }
+        return &m_names.emplace(std::move(key), name_list(std::move(*names))).first->second;
+    }
+
+    std::optional<std::string> flake_output_cache::type_of(nix::EvalState& state, const std::vector<nix::Symbol>& attr_path)
+    {
+        std::optional<std::string> type;
+        visit(state, attr_path, [&](nix::eval_cache::AttrCursor& cursor) {
+            // the cache only keeps these kinds of values. a path is kept as a string without
+            // context, so a string without one is left to a real evaluation
+            auto attempt = [&](std::string_view name, auto get) {
+                if (type)
+                {
+                    return;
+                }
+                try
+                {
+                    if (get())
+                    {
+                        type = name;
+                    }
+                }
+                catch (const nix::TypeError&)
+                {
+                }
+            };
+            attempt("a set", [&] { cursor.getAttrs(state); return true; });
+            attempt("a Boolean", [&] { cursor.getBool(state); return true; });
+            attempt("an integer", [&] { cursor.getInt(state); return true; });
+            attempt("a list", [&] { cursor.getListOfStrings(state); return true; });
+            attempt("a string with context", [&] { return !cursor.getStringWithContext(state).second.empty(); });
+        });
+        return type;
+    }
+
+    std::optional<nix::StorePath> flake_output_cache::derivation(nix::EvalState& state, const std::vector<nix::Symbol>& attr_path)
+    {
+        std::optional<nix::StorePath> drv_path;
+        visit(state, attr_path, [&](nix::eval_cache::AttrCursor& cursor) {
+            if (cursor.isDerivation(state))
+            {
+                drv_path = cursor.forceDerivation(state);
+            }
+        });
+        return drv_path;
+    }
+}
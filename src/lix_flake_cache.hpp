@@ -0,0 +1,71 @@
+#ifndef XEUS_LIX_FLAKE_CACHE_HPP
+#define XEUS_LIX_FLAKE_CACHE_HPP
+
+#include "lix_symbol_index.hpp"
+
+#include "lix/libexpr/eval-cache.hh"
+#include "lix/libexpr/eval.hh"
+#include "lix/libexpr/flake/flake.hh"
+
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace xeus_lix
+{
+    // the outputs of a flake loaded with `:lf`, read through lix's evaluation cache
+    // under pure evaluation the cache is the sqlite database `nix build` and `nix search`
+    // use for the same locked flake, keyed by its fingerprint, so attribute names, strings
+    // and derivation paths found there once come back in later sessions without evaluating
+    // the flake. an impure evaluation can also depend on the system and on what nixpkgs
+    // reads from the environment, so it gets a database of its own, keyed on those as
+    // well, that nix never reads.
+    // whatever the cache cannot answer is looked up in the outputs bound in the REPL, and
+    // recorded
+    class flake_output_cache
+    {
+    public:
+        using visitor = std::function<void(nix::eval_cache::AttrCursor&)>;
+
+        // `flake` is what `outputs` was called from
+        flake_output_cache(nix::Evaluator& evaluator, const nix::flake::LockedFlake& flake, nix::Value& flake_value);
+
+        // the attribute path below the outputs that the REPL variable `name` stands for,
+        // if it is still bound to what the flake gave it
+        std::optional<std::vector<nix::Symbol>> attr_path_of(nix::Symbol name, nix::Value* bound) const;
+
+        // calls `visit` with the cursor at `attr_path` below the outputs and returns true,
+        // or returns false if there is no such attribute
+        // every call opens the cache afresh, so whether it had to evaluate anything is
+        // known per lookup and not just for the first one
+        bool visit(nix::EvalState& state, const std::vector<nix::Symbol>& attr_path, const visitor& visit);
+
+        // the sorted names of the set at `attr_path`, null if it is not a set
+        const name_list* attr_names(nix::EvalState& state, const std::vector<nix::Symbol>& attr_path);
+        // the type of the value at `attr_path` as nix::showType puts it, if the cache knows it
+        std::optional<std::string> type_of(nix::EvalState& state, const std::vector<nix::Symbol>& attr_path);
+        // the derivation at `attr_path`, if that is one
+        std::optional<nix::StorePath> derivation(nix::EvalState& state, const std::vector<nix::Symbol>& attr_path);
+
+        // false if the eval-cache setting is off; lookups are then only counted
+        bool persistent() const { return m_persistent; }
+        size_t hits() const { return m_hits; }
+        size_t misses() const { return m_misses; }
+
+    private:
+        nix::Evaluator& m_evaluator;
+        nix::Hash m_fingerprint;
+        bool m_persistent;
+        nix::RootValue m_flake;
+        nix::RootValue m_outputs;
+        // attribute names by dotted path; views into the symbol table
+        std::unordered_map<std::string, name_list> m_names;
+        size_t m_hits = 0;
+        size_t m_misses = 0;
+    };
+}
+
+#endif
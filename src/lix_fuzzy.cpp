@@ -0,0 +1,200 @@
+#include "lix_fuzzy.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+
+namespace xeus_lix
+{
+    namespace
+    {
+        // ascii only, and a table rather than std::tolower, whose locale lookup would
+        // dominate the cost of ranking a hundred thousand names
+        constexpr auto LOWER = [] {
+            std::array<char, 256> table{};
+            for (int c = 0; c < 256; ++c)
+            {
+                table[c] = static_cast<char>(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+            }
+            return table;
+        }();
+
+        char lower(char c)
+        {
+            return LOWER[static_cast<unsigned char>(c)];
+        }
+
+        constexpr auto CHARACTER_BIT = [] {
+            std::array<uint8_t, 256> table{};
+            table.fill(63);
+            for (int c = 'a'; c <= 'z'; ++c)
+            {
+                table[c] = static_cast<uint8_t>(c - 'a');
+                table[c - 'a' + 'A'] = static_cast<uint8_t>(c - 'a');
+            }
+            for (int c = '0'; c <= '9'; ++c)
+            {
+                table[c] = static_cast<uint8_t>(26 + c - '0');
+            }
+            table['-'] = 36;
+            table['_'] = 37;
+            table['\''] = 38;
+            table['.'] = 39;
+            return table;
+        }();
+
+        bool is_word_start(std::string_view s, size_t i)
+        {
+            if (i == 0)
+            {
+                return true;
+            }
+            const unsigned char prev = s[i - 1];
+            const unsigned char cur = s[i];
+            return prev == '-' || prev == '_' || prev == '.' || prev == '\''
+                || (std::islower(prev) && std::isupper(cur))
+                || (!std::isdigit(prev) && std::isdigit(cur));
+        }
+    }
+
+    std::optional<int> fuzzy_score(std::string_view pattern, std::string_view candidate)
+    {
+        if (pattern.empty())
+        {
+            return 0;
+        }
+
+        // forward pass: where the leftmost subsequence match ends. most candidates fail
+        // here, so it is kept as tight as possible
+        size_t pi = 0;
+        size_t end = 0;
+        char want = lower(pattern[0]);
+        for (size_t i = 0; i < candidate.size(); ++i)
+        {
+            if (lower(candidate[i]) == want)
+            {
+                end = i + 1;
+                if (++pi == pattern.size())
+                {
+                    break;
+                }
+                want = lower(pattern[pi]);
+            }
+        }
+        if (pi < pattern.size())
+        {
+            return std::nullopt;
+        }
+
+        // backward pass from that end: the latest start, i.e. the tightest window
+        size_t start = end;
+        pi = pattern.size();
+        while (pi > 0)
+        {
+            --start;
+            if (lower(candidate[start]) == lower(pattern[pi - 1]))
+            {
+                --pi;
+            }
+        }
+
+        int score = -static_cast<int>(std::min<size_t>(start, 8));
+        size_t prev = std::string_view::npos;
+        pi = 0;
+        for (size_t i = start; i < end && pi < pattern.size(); ++i)
+        {
+            if (lower(candidate[i]) != lower(pattern[pi]))
+            {
+                continue;
+            }
+            score += 16;
+            if (candidate[i] == pattern[pi])
+            {
+                score += 1;
+            }
+            if (is_word_start(candidate, i))
+            {
+                score += i == 0 ? 24 : 12;
+            }
+            if (prev != std::string_view::npos)
+            {
+                score += i == prev + 1 ? 10 : -static_cast<int>(std::min<size_t>(i - prev - 1, 8));
+            }
+            prev = i;
+            ++pi;
+        }
+        return score;
+    }
+
+    uint64_t character_mask(std::string_view s)
+    {
+        uint64_t mask = 0;
+        for (char c : s)
+        {
+            mask |= uint64_t(1) << CHARACTER_BIT[static_cast<unsigned char>(c)];
+        }
+        return mask;
+    }
+
+    fuzzy_ranker::fuzzy_ranker(std::string_view pattern, size_t limit)
+        : m_pattern(pattern)
+        , m_limit(limit)
+    {
+        m_heap.reserve(limit + 1);
+    }
+
+    bool fuzzy_ranker::better(const scored& a, const scored& b)
+    {
+        if (a.score != b.score)
+        {
+            return a.score > b.score;
+        }
+        if (a.name.size() != b.name.size())
+        {
+            return a.name.size() < b.name.size();
+        }
+        return a.name < b.name;
+    }
+
+    void fuzzy_ranker::offer(std::string_view candidate)
+    {
+        if (m_limit == 0)
+        {
+            return;
+        }
+        auto score = fuzzy_score(m_pattern, candidate);
+        if (!score)
+        {
+            return;
+        }
+        scored s{ *score, candidate };
+        if (m_heap.size() == m_limit)
+        {
+            if (!better(s, m_heap.front()))
+            {
+                return;
+            }
+            std::pop_heap(m_heap.begin(), m_heap.end(), better);
+            m_heap.pop_back();
+        }
+        m_heap.push_back(s);
+        std::push_heap(m_heap.begin(), m_heap.end(), better);
+    }
+
+    std::vector<std::string_view> fuzzy_ranker::take()
+    {
+        std::sort(m_heap.begin(), m_heap.end(), better);
+        std::vector<std::string_view> names;
+        names.reserve(m_heap.size());
+        for (const auto& s : m_heap)
+        {
+            // a name offered twice scores the same both times, so copies end up adjacent
+            if (names.empty() || names.back() != s.name)
+            {
+                names.push_back(s.name);
+            }
+        }
+        m_heap.clear();
+        return names;
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef XEUS_LIX_FUZZY_HPP
+#define XEUS_LIX_FUZZY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace xeus_lix
+{
+    // scores `candidate` as a case-insensitive subsequence match of `pattern`, or returns
+    // nullopt if it is not one. matches at the start of the name, after `-`, `_`, `.` or
+    // at a camelCase hump, and runs of consecutive characters score higher; gaps cost
+    std::optional<int> fuzzy_score(std::string_view pattern, std::string_view candidate);
+
+    // one bit per character `s` contains, case-insensitively: letters, digits and the
+    // punctuation of attribute names get a bit each, everything else shares one. a name
+    // can only match a pattern if its mask contains the pattern's
+    uint64_t character_mask(std::string_view s);
+    inline bool may_match(uint64_t pattern_mask, uint64_t candidate_mask)
+    {
+        return (pattern_mask & ~candidate_mask) == 0;
+    }
+
+    // keeps the `limit` best fuzzy matches among the candidates offered to it
+    // ties go to the shorter, then the alphabetically smaller name, and a name offered
+    // more than once is only returned once. the candidates must outlive the ranker, since
+    // only views are kept
+    class fuzzy_ranker
+    {
+    public:
+        fuzzy_ranker(std::string_view pattern, size_t limit);
+
+        void offer(std::string_view candidate);
+        // the kept matches, best first
+        std::vector<std::string_view> take();
+
+    private:
+        struct scored
+        {
+            int score;
+            std::string_view name;
+        };
+        static bool better(const scored& a, const scored& b);
+
+        std::string_view m_pattern;
+        size_t m_limit;
+        // a heap with the worst kept match on top
+        std::vector<scored> m_heap;
+    };
+}
+
+#endif
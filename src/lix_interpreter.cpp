@@ -1,9 +1,31 @@
 #include "lix_interpreter.hpp"
+#include "lix_attr_cache.hpp"
+#include "lix_attr_index.hpp"
+#include "lix_build_jobs.hpp"
+#include "lix_build_log.hpp"
+#include "lix_cancellation.hpp"
+#include "lix_completion_context.hpp"
+#include "lix_doc_cache.hpp"
+#include "lix_doc_index.hpp"
+#include "lix_eval_worker.hpp"
+#include "lix_file_watch.hpp"
+#include "lix_flake_cache.hpp"
+#include "lix_fuzzy.hpp"
+#include "lix_lexer.hpp"
 #include "lix_logger.hpp"
+#include "lix_parse_cache.hpp"
+#include "lix_repl_scope.hpp"
+#include "lix_search_index.hpp"
+#include "lix_segmenter.hpp"
+#include "lix_server.hpp"
+#include "lix_session.hpp"
+#include "lix_stream_buffer.hpp"
+#include "lix_symbol_index.hpp"
+#include "lix_value_printer.hpp"
 
 #include <algorithm>
 #include <memory>
-#include <regex>
+#include <mutex>
 #include <string_view>
 
 #include "lix/config.h"
@@ -11,6 +33,7 @@
 #include "lix/libexpr/eval-error.hh"
 #include "lix/libexpr/eval.hh"
 #include "lix/libexpr/flake/flake.hh"
+#include "lix/libstore/globals.hh"
 #include "lix/libstore/store-api.hh"
 #include "lix/libutil/canon-path.hh"
 #include "lix/libutil/error.hh"
@@ -22,174 +45,379 @@
 
 namespace xeus_lix
 {
-    interpreter::interpreter()
-        : m_aio(std::make_unique<nix::AsyncIoRoot>())
-        , m_store(m_aio->blockOn(nix::openStore()))
-        , m_evaluator(std::make_unique<nix::Evaluator>(*m_aio, nix::SearchPath{}, m_store))
-        , m_evalState(m_evaluator->begin(*m_aio))
-        , m_localEnv(nullptr)
-        , m_staticEnv(nullptr)
-        , m_displacement(0)
+    namespace
+    {
+        // the parser reports input that merely stops too early with one of these messages
+        bool is_unexpected_eof(const nix::ParseError& e)
+        {
+            std::string_view error_msg = e.what();
+            return error_msg.find("unexpected end of file") != std::string_view::npos
+                || error_msg.find("expression ended unexpectedly") != std::string_view::npos;
+        }
+
+        // the identifier or attribute path around the cursor
+        std::string word_at(const std::string& code, int cursor_pos)
+        {
+            auto is_ident_char = [](char c) {
+                return isalnum(c) || c == '_' || c == '-' || c == '.' || c == '\'';
+            };
+
+            size_t end = cursor_pos;
+            while (end < code.length() && is_ident_char(code[end]))
+            {
+                end++;
+            }
+            size_t start = cursor_pos;
+            while (start > 0 && is_ident_char(code[start - 1]))
+            {
+                start--;
+            }
+            return code.substr(start, end - start);
+        }
+    }
+
+    interpreter::interpreter(eval_worker& worker, const interpreter_options& options)
+        : m_worker(worker)
+        , m_prewarm(options.prewarm)
+        , m_streams(std::make_unique<stream_buffer>([this](const std::string& name, const std::string& text) {
+            publish("stream", { { "name", name }, { "text", text } });
+        }))
         , m_logger(std::make_unique<JupyterLogger>(this))
+        , m_cancel(std::make_unique<cancellation_token>())
+        , m_file_watch(std::make_unique<file_watch>())
+        , m_quiet(true)
+        , m_scope_generation(0)
+        , m_parse_cache(std::make_unique<parse_cache>(PARSE_CACHE_SIZE))
+        , m_attr_cache(std::make_unique<attr_name_cache>())
+        , m_symbol_index(std::make_unique<symbol_index>())
+        , m_attr_index(std::make_unique<persistent_attr_index>(cache_directory() / "attr-index"))
+        , m_doc_cache(std::make_unique<doc_comment_cache>())
+        , m_build_logs(std::make_unique<build_log_cache>())
+        , m_started(std::chrono::steady_clock::now())
     {
-        initialize_scope();
+        if (options.replay_session)
+        {
+            m_session = std::make_unique<session_manifest>(session_key());
+        }
+        set_interrupt_target(m_cancel.get());
         // redirect Lix's global logger to our Jupyter logger
         nix::logger = m_logger.get();
         nix::verbosity = nix::lvlInfo;
+        // a slow daemon must not keep the kernel from answering kernel_info, so the store
+        // is opened once the kernel runs; every later job on the worker comes after this
+        m_worker.post([this] { initialize(); });
+    }
+
+    void interpreter::initialize()
+    {
+        try
+        {
+            m_aio = std::make_unique<nix::AsyncIoRoot>();
+            // a failed target of a `:b` batch must not cancel the others; a daemon gets this
+            // once, with the options sent when a connection is set up
+            nix::settings.keepGoing = true;
+            m_store = m_aio->blockOn(nix::openStore()).get_ptr();
+            m_evaluator = std::make_unique<nix::Evaluator>(*m_aio, nix::SearchPath{}, nix::ref<nix::Store>(m_store));
+            m_evalStateBox.emplace(m_evaluator->begin(*m_aio));
+            m_evalState = &**m_evalStateBox;
+
+            // the builtins never change, so they are indexed for completion only once
+            std::vector<std::string_view> builtin_names;
+            for (const auto& [symbol, displ] : m_evaluator->builtins.staticEnv->vars)
+            {
+                std::string_view name = m_evaluator->symbols[symbol];
+                if (!name.starts_with("__")) // exclude internal builtins
+                {
+                    builtin_names.push_back(name);
+                }
+            }
+            std::unique_lock names_lock(m_names_mutex);
+            m_symbol_index->set_builtins(std::move(builtin_names));
+            names_lock.unlock();
+
+            initialize_scope();
+            // output is published from this thread, whenever it checks for an interrupt
+            set_poll_hook([this] { poll_output(); });
+            nix::interruptCheck = [] {
+                run_poll_hook();
+                return false;
+            };
+            // background builds progress while the evaluation thread has nothing else to do
+            m_worker.set_idle_task([this] { return pump_build_jobs(); });
+            m_ready = true;
+        }
+        catch (const std::exception& e)
+        {
+            m_init_error = std::string("the kernel could not set up lix: ") + e.what();
+        }
+        m_quiet = false;
+        m_stats.startup_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_started);
+    }
+
+    // evaluates `expr` for the caches it fills, unless a cell comes first
+    void interpreter::prewarm(const std::string& expr)
+    {
+        if (!m_ready || shutdown_requested())
+        {
+            return;
+        }
+        auto started = std::chrono::steady_clock::now();
+        nix::unsetUserInterruptRequest();
+        m_cancel->reset();
+        // a cell queued from here on interrupts the prewarm; one queued before it is not
+        // kept waiting behind it at all
+        m_prewarming = true;
+        bool cell_waiting;
+        {
+            std::lock_guard lock(m_cells_mutex);
+            cell_waiting = !m_cells.empty();
+        }
+        if (cell_waiting)
+        {
+            m_prewarming = false;
+            m_stats.prewarm_outcome = "interrupted by a cell";
+            return;
+        }
+        m_quiet = true;
+        try
+        {
+            nix::Value v(nix::Value::null_t{});
+            eval_pure_expression(expr, v);
+            m_evalState->forceValue(v, nix::noPos);
+            m_stats.prewarm_outcome = "completed";
+        }
+        catch (const nix::Interrupted&)
+        {
+            m_stats.prewarm_outcome = "interrupted by a cell";
+        }
+        catch (const std::exception& e)
+        {
+            m_stats.prewarm_outcome = std::string("failed: ") + e.what();
+        }
+        m_prewarming = false;
+        m_quiet = false;
+        m_stats.prewarm_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+    }
+
+    void interpreter::poll_output()
+    {
+        m_logger->flush_if_due();
+        m_streams->flush_if_due();
     }
 
     interpreter::~interpreter()
     {
+        m_worker.set_idle_task(nullptr);
+        nix::interruptCheck = nullptr;
+        set_poll_hook(nullptr);
+        set_interrupt_target(nullptr);
         // restore default Lix logger
         nix::logger = nix::makeSimpleLogger();
     }
 
     void interpreter::initialize_scope()
     {
-        m_staticEnv = std::make_shared<nix::StaticEnv>(nullptr, m_evaluator->builtins.staticEnv.get());
-        m_localEnv = &m_evaluator->mem.allocEnv(NIX_ENV_SIZE);
-        m_localEnv->up = &m_evaluator->builtins.env;
-        m_displacement = 0;
+        m_scope = std::make_unique<repl_scope>(*m_evaluator);
+        ++m_scope_generation;
+        std::unique_lock names_lock(m_names_mutex);
+        m_attr_cache->clear();
+        m_symbol_index->clear_scope();
+        names_lock.unlock();
+        m_loaded_sources.clear();
+        m_flakes.clear();
+        m_search_indexes.clear();
+        m_doc_indexes.clear();
     }
 
-    void interpreter::configure_impl(){}
+    void interpreter::publish(const std::string& msg_type, json content)
+    {
+        if (auto parent = request_context::current())
+        {
+            publish_in_request(*parent, msg_type, std::move(content));
+            return;
+        }
+        // outside of any request, e.g. a warning lix logged for a background build between
+        // cells: the parent header xeus keeps is the shell thread's, so it waits for a cell
+        m_held_output.emplace_back(msg_type, std::move(content));
+    }
 
-    void interpreter::shutdown_request_impl(){}
+    void interpreter::publish_held_output()
+    {
+        m_streams->flush();
+        auto parent = request_context::current();
+        for (auto& [msg_type, content] : std::exchange(m_held_output, {}))
+        {
+            publish_in_request(*parent, msg_type, std::move(content));
+        }
+    }
 
-    void interpreter::execute_chunk(const std::string& chunk, bool is_last_chunk, int execution_counter)
+    void interpreter::publish_stream(const std::string& name, const std::string& text)
     {
-        std::string first_meaningful_line;
-        bool has_meaningful_content = false;
+        if (m_quiet)
         {
-            std::istringstream stream(chunk);
-            std::string line;
-            while (std::getline(stream, line))
-            {
-                std::string trimmed_line = nix::trim(line);
-                if (!trimmed_line.empty() && trimmed_line[0] != '#')
-                {
-                    first_meaningful_line = trimmed_line;
-                    has_meaningful_content = true;
-                    break;
-                }
-            }
+            return;
         }
+        m_streams->write(name, text);
+    }
 
-        if (!has_meaningful_content)
+    void interpreter::display_data(json data, json metadata, json transient)
+    {
+        if (m_quiet)
         {
             return;
         }
+        m_streams->flush();
+        publish(
+            "display_data",
+            { { "data", std::move(data) }, { "metadata", std::move(metadata) }, { "transient", std::move(transient) } }
+        );
+    }
 
-        if (first_meaningful_line[0] == '!')
+    void interpreter::update_display_data(json data, json metadata, json transient)
+    {
+        if (m_quiet)
         {
-            execute_shell_command(chunk);
+            return;
         }
-        else if (first_meaningful_line[0] == ':')
+        m_streams->flush();
+        publish(
+            "update_display_data",
+            { { "data", std::move(data) }, { "metadata", std::move(metadata) }, { "transient", std::move(transient) } }
+        );
+    }
+
+    void interpreter::publish_execution_result(int execution_count, json data, json metadata)
+    {
+        m_streams->flush();
+        publish(
+            "execute_result",
+            { { "execution_count", execution_count }, { "data", std::move(data) }, { "metadata", std::move(metadata) } }
+        );
+    }
+
+    void interpreter::publish_execution_error(const std::string& ename, const std::string& evalue, const std::vector<std::string>& trace_back)
+    {
+        m_streams->flush();
+        publish("error", { { "ename", ename }, { "evalue", evalue }, { "traceback", trace_back } });
+    }
+
+    void interpreter::configure_impl()
+    {
+        // requests are taken as soon as this returns; they queue behind the replay on the
+        // evaluation thread, while completion answers from what earlier sessions indexed
+        if (m_session && !m_session->commands().empty())
         {
-            handle_repl_command(nix::trim(chunk));
+            m_worker.post([this] { replay_session(); });
         }
-        else
+        if (!m_prewarm.empty())
         {
-            auto result_variant = m_evaluator->parseReplInput(chunk, nix::CanonPath::fromCwd(), m_staticEnv);
-            std::visit(
-                nix::overloaded{
-                    [&](nix::ExprReplBindings& bindings) {
-                        for (auto& [name, expr] : bindings.symbols)
-                        {
-                            nix::Value* val = m_evaluator->mem.allocValue();
-                            expr->eval(*m_evalState, *m_localEnv, *val);
-                            (void)expr.release();
-                            m_staticEnv->vars.insert_or_assign(name, m_displacement);
-                            m_localEnv->values[m_displacement++] = val;
-                        }
-                    },
-                    [&](std::unique_ptr<nix::Expr>& expr) {
-                        nix::Value val(nix::Value::null_t{});
-                        expr->eval(*m_evalState, *m_localEnv, val);
-                        (void)expr.release();
+            m_worker.post([this] { prewarm(m_prewarm); });
+        }
+    }
 
-                        nl::json pub_data;
-                        bool is_publishable = false;
+    void interpreter::shutdown_request_impl(){}
 
-                        // check for rich MIME type representations
-                        try
+    void interpreter::execute_chunk(parsed_input& parsed, bool is_last_chunk, int execution_counter)
+    {
+        parsed.evaluated = true;
+        std::visit(
+            nix::overloaded{
+                [&](nix::ExprReplBindings& bindings) {
+                    // binding may chain a new segment onto the scope; the right-hand sides
+                    // were parsed against the current one, so they are all evaluated in it
+                    nix::Env& env = m_scope->env();
+                    for (auto& [name, expr] : bindings.symbols)
+                    {
+                        nix::Value* val = m_evaluator->mem.allocValue();
+                        expr->eval(*m_evalState, env, *val);
+                        m_scope->bind(name, val);
+                        ++m_scope_generation;
+                        std::string_view name_sv = m_evaluator->symbols[name];
+                        std::unique_lock names_lock(m_names_mutex);
+                        m_symbol_index->add(name_sv);
+                        m_attr_cache->invalidate_roots([&](std::string_view root) { return root == name_sv; });
+                    }
+                },
+                [&](std::unique_ptr<nix::Expr>& expr) {
+                    nix::Value val(nix::Value::null_t{});
+                    expr->eval(*m_evalState, m_scope->env(), val);
+
+                    nl::json pub_data;
+                    bool is_publishable = false;
+
+                    // check for rich MIME type representations
+                    try
+                    {
+                        m_evalState->forceValue(val, nix::noPos);
+                        if (val.type() == nix::nAttrs)
                         {
-                            m_evalState->forceValue(val, nix::noPos);
-                            if (val.type() == nix::nAttrs)
+                            // a `_toMime` attribute signals a rich representation
+                            if (auto it = val.attrs->find(m_evaluator->symbols.create("_toMime"));
+                                it != val.attrs->end())
                             {
-                                // a `_toMime` attribute signals a rich representation
-                                if (auto it = val.attrs->find(m_evaluator->symbols.create("_toMime"));
-                                    it != val.attrs->end())
+                                nix::Value& mime_set_val = *it->value;
+                                m_evalState->forceAttrs(mime_set_val, it->pos, "while rendering _toMime");
+
+                                nl::json data_bundle;
+                                for (const auto& attr : *mime_set_val.attrs)
                                 {
-                                    nix::Value& mime_set_val = *it->value;
-                                    m_evalState->forceAttrs(mime_set_val, it->pos, "while rendering _toMime");
-
-                                    nl::json data_bundle;
-                                    for (const auto& attr : *mime_set_val.attrs)
-                                    {
-                                        std::string_view mime_type_sv = m_evaluator->symbols[attr.name];
-                                        std::string mime_type(mime_type_sv);
-                                        nix::Value& data_val_ref = *attr.value;
-                                        std::string data_str(
-                                            m_evalState->forceString(data_val_ref, attr.pos, "mime data")
-                                        );
-                                        // TODO: handle escape sequences or verify the frontend does so
-                                        data_bundle[mime_type] = data_str;
-                                    }
-                                    pub_data["data"] = data_bundle;
-                                    pub_data["metadata"] = nl::json::object();
-                                    is_publishable = true;
+                                    std::string_view mime_type_sv = m_evaluator->symbols[attr.name];
+                                    std::string mime_type(mime_type_sv);
+                                    nix::Value& data_val_ref = *attr.value;
+                                    std::string data_str(
+                                        m_evalState->forceString(data_val_ref, attr.pos, "mime data")
+                                    );
+                                    // TODO: handle escape sequences or verify the frontend does so
+                                    data_bundle[mime_type] = data_str;
                                 }
+                                pub_data["data"] = data_bundle;
+                                pub_data["metadata"] = nl::json::object();
+                                is_publishable = true;
                             }
                         }
-                        catch (...)
+                    }
+                    catch (...)
+                    {
+                        // fallback to 'text/plain' if _toMime lookup fails
+                    }
+
+                    if (is_publishable)
+                    {
+                        if (is_last_chunk)
                         {
-                            // fallback to 'text/plain' if _toMime lookup fails
+                            publish_execution_result(
+                                execution_counter,
+                                std::move(pub_data["data"]),
+                                std::move(pub_data["metadata"])
+                            );
                         }
-
-                        if (is_publishable)
+                        else
                         {
-                            if (is_last_chunk)
-                            {
-                                publish_execution_result(
-                                    execution_counter,
-                                    std::move(pub_data["data"]),
-                                    std::move(pub_data["metadata"])
-                                );
-                            }
-                            else
+                            if (pub_data["data"].contains("text/plain"))
                             {
-                                if (pub_data["data"].contains("text/plain"))
-                                {
-                                    publish_stream("stdout", pub_data["data"]["text/plain"].get<std::string>() + "\n");
-                                }
+                                publish_stream("stdout", pub_data["data"]["text/plain"].get<std::string>() + "\n");
                             }
                         }
+                    }
+                    else
+                    {
+                        // fallback to 'text/plain', within limits so that printing nixpkgs
+                        // by accident does not force and format all of it
+                        std::string text = print_value(val, RESULT_PRINT_LIMITS);
+                        if (is_last_chunk)
+                        {
+                            nl::json res;
+                            res["text/plain"] = text;
+                            publish_execution_result(execution_counter, std::move(res), nl::json::object());
+                        }
                         else
                         {
-                            // fallback to 'text/plain'
-                            std::stringstream ss;
-                            nix::printValue(
-                                *m_evalState,
-                                ss,
-                                val,
-                                nix::PrintOptions{ .ansiColors = true, .force = true, .prettyIndent = 2 }
-                            );
-                            if (is_last_chunk)
-                            {
-                                nl::json res;
-                                res["text/plain"] = ss.str();
-                                publish_execution_result(execution_counter, std::move(res), nl::json::object());
-                            }
-                            else
-                            {
-                                publish_stream("stdout", ss.str() + "\n");
-                            }
+                            publish_stream("stdout", text + "\n");
                         }
-                    } },
-                result_variant
-            );
-        }
+                    }
+                } },
+            parsed.result
+        );
     }
 
     void interpreter::execute_request_impl(
@@ -200,133 +428,138 @@ namespace xeus_lix
         nl::json
     )
     {
+        // the cell runs on the evaluation thread and replies from there, so the shell
+        // thread is free to answer completion and inspection requests in the meantime
+        {
+            std::lock_guard lock(m_cells_mutex);
+            m_cells.push_back({ .cb = std::move(cb), .execution_counter = execution_counter, .code = code, .parent_header = parent_header() });
+        }
+        // the cell should not wait for an expression evaluated only to warm the caches
+        if (m_prewarming)
+        {
+            request_interrupt();
+        }
+        m_worker.post([this] { run_next_cell(); });
+    }
+
+    void interpreter::run_next_cell()
+    {
+        std::unique_lock lock(m_cells_mutex);
+        if (m_cells.empty())
+        {
+            return; // aborted by an earlier cell's error
+        }
+        queued_cell cell = std::move(m_cells.front());
+        m_cells.pop_front();
+        lock.unlock();
+
+        request_context context(cell.parent_header);
+        publish_held_output();
+        execute_cell(cell.cb, cell.execution_counter, cell.code);
+        // the cell failed and its request had `stop_on_error`, as "Run All" sends it
+        if (take_abort_request())
+        {
+            abort_queued_cells();
+        }
+    }
+
+    void interpreter::abort_queued_cells()
+    {
+        std::deque<queued_cell> aborted;
+        {
+            std::lock_guard lock(m_cells_mutex);
+            aborted.swap(m_cells);
+        }
+        for (auto& cell : aborted)
+        {
+            request_context context(cell.parent_header);
+            cell.cb(nl::json{ { "status", "aborted" } });
+        }
+    }
+
+    void interpreter::execute_cell(send_reply_callback cb, int execution_counter, const std::string& code)
+    {
+        // the server is going away: cells queued behind the one the shutdown interrupted
+        // do not run, and that one does not report its interruption
+        if (shutdown_requested())
+        {
+            return;
+        }
+
         // helper to publish errors to the frontend.
         auto send_error = [&](const std::string& ename, const std::string& evalue) {
+            if (shutdown_requested())
+            {
+                return;
+            }
+            m_logger->end_cell();
             std::vector<std::string> traceback = { evalue };
             publish_execution_error(ename, evalue, traceback);
             cb(xeus::create_error_reply(evalue, ename, traceback));
         };
 
+        if (!m_ready)
+        {
+            send_error("KernelError", m_init_error);
+            return;
+        }
+
         try
         {
             nix::unsetUserInterruptRequest();
-
-            // code cells can contain multiple expressions, REPL commands, and shell commands
-            // this logic splits the code into executable chunks
-            std::vector<std::string> chunks;
-            std::string current_buffer;
-            std::istringstream code_stream(code);
-            std::string line;
-            bool in_shell_block = false;
-
-            auto flush_buffer = [&]() {
-                if (!nix::trim(current_buffer).empty())
-                {
-                    chunks.push_back(current_buffer);
-                }
-                current_buffer.clear();
-            };
-
-            while (std::getline(code_stream, line))
+            m_cancel->reset();
+            m_logger->begin_cell();
+            for (const auto& error : m_replay_errors)
             {
-                std::string trimmed_line = nix::trim(line);
-                bool is_shell_line_start = !trimmed_line.empty() && trimmed_line.front() == '!';
-
-                if (in_shell_block)
-                {
-                    current_buffer += line + '\n';
-                    if (trimmed_line.empty() || trimmed_line.back() != '\\')
-                    {
-                        in_shell_block = false;
-                        flush_buffer();
-                    }
-                }
-                else if (is_shell_line_start)
-                {
-                    flush_buffer();
-                    current_buffer += line + '\n';
-                    if (!trimmed_line.empty() && trimmed_line.back() == '\\')
-                    {
-                        in_shell_block = true;
-                    }
-                    else
-                    {
-                        flush_buffer();
-                    }
-                }
-                else if (!trimmed_line.empty() && trimmed_line.front() == ':')
-                {
-                    flush_buffer();
-                    chunks.push_back(line + '\n');
-                }
-                else
-                {
-                    if (current_buffer.empty() && trimmed_line.empty())
-                    {
-                        continue;
-                    }
-
-                    current_buffer += line + '\n';
-
-                    // heuristic to split expressions:
-                    // try to parse the current buffer
-                    // if it parses successfully, it's a complete chunk
-                    // if it fails with an "unexpected end of file" error, it's incomplete
-                    // if it fails with another parse error, assume a syntax error and treat
-                    // the buffer as a chunk to let the evaluator report the error
-                    try
-                    {
-                        (void)m_evaluator->parseReplInput(current_buffer, nix::CanonPath::fromCwd(), m_staticEnv);
-                        flush_buffer();
-                    }
-                    catch (const nix::ParseError& e)
-                    {
-                        std::string error_msg = e.what();
-                        if (error_msg.find("unexpected end of file") == std::string::npos
-                            && error_msg.find("expression ended unexpectedly") == std::string::npos)
-                        {
-                            flush_buffer();
-                        }
-                    }
-                    catch (const nix::UndefinedVarError&)
-                    {
-                        // ignore undefined variable errors as variable might be defined in a preceding chunk of the cell
-                    }
-                }
+                publish_stream("stderr", "Session replay: " + error + "\n");
             }
-            flush_buffer();
+            m_replay_errors.clear();
 
+            // code cells can contain multiple expressions, REPL commands, and shell commands
+            // they are split lexically in one pass; each expression is then parsed once,
+            // right before it runs, so that bindings made by earlier chunks are in scope
+            auto chunks = split_cell(code);
             for (size_t i = 0; i < chunks.size(); ++i)
             {
-                const auto& chunk = chunks[i];
-                if (nix::trim(chunk).empty())
-                {
-                    continue;
-                }
-
-                bool is_last_expression = true;
-                if (i < chunks.size() - 1)
+                m_cancel->check();
+                switch (chunks[i].type)
                 {
-                    is_last_expression = false;
-                }
-                else
+                case cell_chunk::kind::shell_command:
+                    execute_shell_command(chunks[i].text);
+                    break;
+                case cell_chunk::kind::repl_command:
+                    handle_repl_command(nix::trim(chunks[i].text));
+                    break;
+                case cell_chunk::kind::expression:
                 {
-                    // an assignment cannot be the final result of a cell
-                    try
+                    std::string source = std::move(chunks[i].text);
+                    std::shared_ptr<parsed_input> parsed;
+                    while (!parsed)
                     {
-                        auto result_variant = m_evaluator->parseReplInput(chunk, nix::CanonPath::fromCwd(), m_staticEnv);
-                        if (std::holds_alternative<nix::ExprReplBindings>(result_variant))
+                        try
                         {
-                            is_last_expression = false;
+                            parsed = parse_repl_input(source);
+                        }
+                        catch (const nix::ParseError& e)
+                        {
+                            // the segmenter cut an expression it could not see the end of (e.g. an
+                            // operator it does not know about); glue the next expression on and retry
+                            bool can_merge = i + 1 < chunks.size() && chunks[i + 1].type == cell_chunk::kind::expression;
+                            if (!can_merge || !is_unexpected_eof(e))
+                            {
+                                throw;
+                            }
+                            source += chunks[++i].text;
                         }
                     }
-                    catch (...)
-                    {
-                    }
+                    execute_chunk(*parsed, i + 1 == chunks.size(), execution_counter);
+                    break;
+                }
                 }
-                execute_chunk(chunk, is_last_expression, execution_counter);
             }
 
+            m_logger->end_cell();
+            m_streams->flush();
             cb(xeus::create_successful_reply());
         }
         // catch and report various types exceptions
@@ -364,7 +597,9 @@ namespace xeus_lix
         }
     }
 
-    json interpreter::complete_nix_expression(const std::string_view code, int cursor_pos)
+    // with `evaluate` unset nothing is evaluated: only names already in the symbol index or
+    // the attribute cache are offered, which is what completion can do while a cell runs
+    json interpreter::complete_nix_expression(const std::string_view code, int cursor_pos, bool evaluate)
     {
         std::vector<std::string> matches;
 
@@ -395,63 +630,58 @@ namespace xeus_lix
                 std::string base_expr_str = prefix.substr(0, last_dot_pos);
                 std::string attr_prefix = prefix.substr(last_dot_pos + 1);
 
-                nix::Value base_val(nix::Value::null_t{});
-                eval_pure_expression(base_expr_str, base_val);
-
-                if (base_val.type() == nix::nAttrs)
+                if (auto names = evaluate ? lookup_completion_names(base_expr_str) : cached_completion_names(base_expr_str))
                 {
-                    for (const auto& attr : *base_val.attrs)
+                    fuzzy_ranker ranker(attr_prefix, MAX_COMPLETIONS);
+                    for_each_candidate(*names, attr_prefix, [&](std::string_view name) { ranker.offer(name); });
+                    for (auto name : ranker.take())
                     {
-                        std::string_view attr_name_sv = m_evaluator->symbols[attr.name];
-                        std::string attr_name(attr_name_sv);
-                        if (attr_name.rfind(attr_prefix, 0) == 0)
-                        {
-                            matches.push_back(base_expr_str + "." + attr_name);
-                        }
+                        matches.push_back(base_expr_str + "." + std::string(name));
                     }
                 }
             }
             else // handle top-level variable completion
             {
-                std::set<std::string> candidates;
-                // collect variables from the current static environment chain
-                std::function<void(const nix::StaticEnv*)> collect_vars =
-                    [&](const nix::StaticEnv* senv) {
-                    if (!senv) return;
-                    for (const auto& [symbol, displ] : senv->vars)
+                fuzzy_ranker ranker(prefix, MAX_COMPLETIONS);
+                m_symbol_index->for_each_candidate(prefix, [&](std::string_view name) { ranker.offer(name); });
+
+                // names bound by the code around the cursor: let, rec, lambdas and with
+                auto scope = scope_at(code, start);
+                for (auto name : scope.names)
+                {
+                    if (!m_symbol_index->contains(name))
+                    {
+                        ranker.offer(name);
+                    }
+                }
+                for (auto with_expr : scope.with_exprs)
+                {
+                    // only plain attribute paths are looked up, completion must not run arbitrary code
+                    if (!is_attr_path(with_expr))
                     {
-                        std::string_view var_name_sv = m_evaluator->symbols[symbol];
-                        std::string var_name(var_name_sv);
-                        if (var_name.rfind("__", 0) != 0) // exclude internal builtins
+                        continue;
+                    }
+                    try
+                    {
+                        std::string with_path(with_expr);
+                        if (auto names = evaluate ? lookup_completion_names(with_path) : cached_completion_names(with_path))
                         {
-                            candidates.insert(var_name);
+                            for_each_candidate(*names, prefix, [&](std::string_view name) {
+                                if (!m_symbol_index->contains(name))
+                                {
+                                    ranker.offer(name);
+                                }
+                            });
                         }
                     }
-                    if (senv->up) collect_vars(senv->up);
-                };
-                collect_vars(m_staticEnv.get());
-
-                // find variable names in `let` bindings within the prefix
-                size_t let_pos = prefix.rfind("let ");
-                size_t in_pos = prefix.rfind(" in ");
-                if (let_pos != std::string::npos && (in_pos == std::string::npos || let_pos > in_pos))
-                {
-                    std::string bindings_str = prefix.substr(let_pos + 4);
-                    std::regex var_regex(R"(([a-zA-Z_][a-zA-Z0-9_'-]*)\s*=)");
-                    auto vars_begin = std::sregex_iterator(bindings_str.begin(), bindings_str.end(), var_regex);
-                    auto vars_end = std::sregex_iterator();
-                    for (auto i = vars_begin; i != vars_end; ++i)
+                    catch (...)
                     {
-                        candidates.insert((*i)[1].str());
+                        // e.g. `with` over a let-bound name, which is not in the REPL scope
                     }
                 }
-
-                for (const auto& var_name : candidates)
+                for (auto name : ranker.take())
                 {
-                    if (var_name.rfind(prefix, 0) == 0)
-                    {
-                        matches.push_back(var_name);
-                    }
+                    matches.emplace_back(name);
                 }
             }
         }
@@ -462,8 +692,30 @@ namespace xeus_lix
         return xeus::create_complete_reply(matches, start, end);
     }
 
-    // main completion request handler  dispatches to REPL or expression completion
     json interpreter::complete_request_impl(const std::string& code, int cursor_pos)
+    {
+        std::optional<json> reply;
+        if (m_ready)
+        {
+            reply = m_worker.try_call([&] { return complete_code(code, cursor_pos, true); });
+        }
+        if (!reply)
+        {
+            // a cell is running and owns the evaluator, so answer from the names known so far
+            std::shared_lock names_lock(m_names_mutex);
+            reply = complete_code(code, cursor_pos, false);
+        }
+        if (m_first_completion_ms < 0 && !(*reply)["matches"].empty())
+        {
+            auto since_start = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_started);
+            int64_t unset = -1;
+            m_first_completion_ms.compare_exchange_strong(unset, since_start.count());
+        }
+        return std::move(*reply);
+    }
+
+    // main completion request handler  dispatches to REPL or expression completion
+    json interpreter::complete_code(const std::string& code, int cursor_pos, bool evaluate)
     {
         std::string prefix = code.substr(0, cursor_pos);
         std::string trimmed_prefix = nix::trim(prefix);
@@ -507,7 +759,7 @@ namespace xeus_lix
                     std::string arg_code = prefix.substr(arg_start_pos);
                     int arg_cursor_pos = cursor_pos - arg_start_pos;
 
-                    nl::json res = complete_nix_expression(arg_code, arg_cursor_pos);
+                    nl::json res = complete_nix_expression(arg_code, arg_cursor_pos, evaluate);
                     res["cursor_start"] = res["cursor_start"].get<int>() + arg_start_pos;
                     res["cursor_end"] = cursor_pos;
                     return res;
@@ -515,43 +767,37 @@ namespace xeus_lix
             }
         }
 
-        return complete_nix_expression(code, cursor_pos);
+        return complete_nix_expression(code, cursor_pos, evaluate);
     }
 
-    json interpreter::inspect_request_impl(const std::string& code, int cursor_pos, int)
+    json interpreter::inspect_request_impl(const std::string& code, int cursor_pos, int detail_level)
     {
-        try
+        if (!m_ready)
         {
-            auto is_ident_char = [](char c) {
-                return isalnum(c) || c == '_' || c == '-' || c == '.' || c == '\'';
-            };
-
-            size_t end = cursor_pos;
-            while (end < code.length() && is_ident_char(code[end]))
-            {
-                end++;
-            }
-            size_t start = cursor_pos;
-            while (start > 0 && is_ident_char(code[start - 1]))
-            {
-                start--;
-            }
+            return inspect_while_busy(code, cursor_pos);
+        }
+        if (auto reply = m_worker.try_call([&] { return inspect_code(code, cursor_pos, detail_level); }))
+        {
+            return std::move(*reply);
+        }
+        return inspect_while_busy(code, cursor_pos);
+    }
 
-            std::string to_inspect = code.substr(start, end - start);
-            if (to_inspect.empty() || nix::trim(to_inspect).empty())
+    json interpreter::inspect_code(const std::string& code, int cursor_pos, int detail_level)
+    {
+        try
+        {
+            std::string to_inspect = word_at(code, cursor_pos);
+            if (!is_attr_path(to_inspect))
             {
                 return xeus::create_inspect_reply(false);
             }
 
-            nix::Value v(nix::Value::null_t{});
-            eval_pure_expression(to_inspect, v);
-
-            std::string doc_str = get_doc_string(v);
-
-            if (!doc_str.empty())
+            std::string description = describe_attr_path(to_inspect, detail_level);
+            if (!description.empty())
             {
                 nl::json data;
-                data["text/markdown"] = std::move(doc_str);
+                data["text/markdown"] = std::move(description);
                 return xeus::create_inspect_reply(true, data);
             }
         }
@@ -562,31 +808,68 @@ namespace xeus_lix
         return xeus::create_inspect_reply(false);
     }
 
-    json interpreter::is_complete_request_impl(const std::string& code)
+    // describing a value needs the evaluator; while a cell runs, all that is known is
+    // whether the name exists
+    json interpreter::inspect_while_busy(const std::string& code, int cursor_pos)
     {
-        if (nix::trim(code).empty())
+        std::string to_inspect = word_at(code, cursor_pos);
+        if (!is_attr_path(to_inspect))
         {
-            return xeus::create_is_complete_reply("complete");
+            return xeus::create_inspect_reply(false);
         }
-        try
+
+        std::shared_lock names_lock(m_names_mutex);
+        size_t last_dot_pos = to_inspect.rfind('.');
+        bool known = false;
+        if (last_dot_pos == std::string::npos)
         {
-            (void)m_evaluator->parseReplInput(code, nix::CanonPath::fromCwd(), m_staticEnv);
-            return xeus::create_is_complete_reply("complete");
+            known = m_symbol_index->contains(to_inspect);
         }
-        catch (const nix::ParseError& e)
+        else if (auto names = cached_completion_names(to_inspect.substr(0, last_dot_pos)))
         {
-            std::string error_msg = e.what();
-            if (error_msg.find("unexpected end of file") != std::string::npos
-                || error_msg.find("expression ended unexpectedly") != std::string::npos)
-            {
-                return xeus::create_is_complete_reply("incomplete");
-            }
-            return xeus::create_is_complete_reply("invalid");
+            known = std::binary_search(names->names.begin(), names->names.end(), std::string_view(to_inspect).substr(last_dot_pos + 1));
         }
-        catch (...)
+        if (!known)
+        {
+            return xeus::create_inspect_reply(false);
+        }
+
+        nl::json data;
+        data["text/markdown"] = "`" + to_inspect + "` (the kernel is busy, details are shown once the running cell has finished)";
+        return xeus::create_inspect_reply(true, data);
+    }
+
+    json interpreter::is_complete_request_impl(const std::string& code)
+    {
+        if (nix::trim(code).empty())
+        {
+            return xeus::create_is_complete_reply("complete");
+        }
+        if (!m_ready)
         {
             return xeus::create_is_complete_reply("unknown");
         }
+        auto reply = m_worker.try_call([&] {
+            try
+            {
+                (void)parse_repl_input(code);
+                return xeus::create_is_complete_reply("complete");
+            }
+            catch (const nix::ParseError& e)
+            {
+                if (is_unexpected_eof(e))
+                {
+                    return xeus::create_is_complete_reply("incomplete");
+                }
+                return xeus::create_is_complete_reply("invalid");
+            }
+            catch (...)
+            {
+                return xeus::create_is_complete_reply("unknown");
+            }
+        });
+        // parsing needs the evaluator, which a running cell is using
+        return reply ? std::move(*reply) : xeus::create_is_complete_reply("unknown");
     }
 
     json interpreter::kernel_info_request_impl()
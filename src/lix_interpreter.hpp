@@ -5,9 +5,25 @@
 #include "xeus/xinterpreter.hpp"
 
 #include <lix/libutil/box_ptr.hh>
-#include <lix/libutil/ref.hh>
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace kj
+{
+template<typename T>
+class Promise;
+}
 
 // forward declarations for Lix types to reduce header dependencies.
 namespace nix
@@ -21,6 +37,8 @@ class Evaluator;
 class Logger;
 struct StaticEnv;
 class Store;
+class StorePath;
+class Symbol;
 struct Value;
 }
 
@@ -28,10 +46,49 @@ namespace xeus_lix
 {
     using json = nlohmann::json;
 
+    class attr_name_cache;
+    class build_log_cache;
+    struct build_job;
+    struct build_target;
+    class JupyterLogger;
+    class cancellation_token;
+    class doc_comment_cache;
+    class doc_search_index;
+    class eval_worker;
+    class file_watch;
+    class flake_output_cache;
+    class package_search_index;
+    class parse_cache;
+    class persistent_attr_index;
+    struct print_limits;
+    class repl_scope;
+    class session_manifest;
+    class value_printer;
+    class stream_buffer;
+    class symbol_index;
+    struct attr_listing;
+    struct loaded_file;
+    struct loaded_source;
+    struct name_list;
+    struct parsed_input;
+
+    // what the kernelspec's argv asks for
+    struct interpreter_options
+    {
+        // `--replay-session`: record the commands that set the session up, and run them
+        // again in the background when the kernel for the same notebook starts next
+        bool replay_session = false;
+        // `--prewarm <expr>`: evaluated once the kernel is up and has nothing else to do,
+        // to fill lix's caches, e.g. `import <nixpkgs> {}`
+        std::string prewarm;
+    };
+
     class interpreter : public xeus::xinterpreter
     {
     public:
-        interpreter();
+        // returns right away; lix is set up by the first job on `worker`, which has to
+        // outlive the interpreter and should also destroy it
+        interpreter(eval_worker& worker, const interpreter_options& options);
         virtual ~interpreter();
 
         // the logger needs to access the interpreter's publishing methods
@@ -55,15 +112,71 @@ namespace xeus_lix
         json kernel_info_request_impl() override;
         void shutdown_request_impl() override;
 
+        // everything the kernel publishes goes through these, which hide xinterpreter's own:
+        // stream text is merged in m_streams, anything else flushes it first to keep the order
+        // under the parent header of the request being handled, or held until the next cell
+        void publish(const std::string& msg_type, json content);
+        // what was published outside of any request goes out under the current one
+        void publish_held_output();
+        void publish_stream(const std::string& name, const std::string& text);
+        void display_data(json data, json metadata, json transient);
+        void update_display_data(json data, json metadata, json transient);
+        void publish_execution_result(int execution_count, json data, json metadata);
+        void publish_execution_error(const std::string& ename, const std::string& evalue, const std::vector<std::string>& trace_back);
+
+        // an execute request, from when the shell thread takes it until it runs; the parent
+        // header is only the request's own while the shell thread dispatches it
+        struct queued_cell
+        {
+            send_reply_callback cb;
+            int execution_counter;
+            std::string code;
+            json parent_header;
+        };
+
         // helper Functions
-        void execute_chunk(const std::string& chunk, bool is_last_chunk, int execution_counter);
+        void run_next_cell();
+        void abort_queued_cells();
+        void execute_cell(send_reply_callback cb, int execution_counter, const std::string& code);
+        json complete_code(const std::string& code, int cursor_pos, bool evaluate);
+        json inspect_code(const std::string& code, int cursor_pos, int detail_level);
+        json inspect_while_busy(const std::string& code, int cursor_pos);
+        void execute_chunk(parsed_input& parsed, bool is_last_chunk, int execution_counter);
+        std::shared_ptr<parsed_input> parse_repl_input(std::string_view code);
         void execute_shell_command(std::string_view command_block);
         void handle_repl_command(const std::string& command_line);
         void add_to_scope(nix::Bindings& bindings);
         void eval_pure_expression(std::string_view expr_str, nix::Value& result);
-        std::string get_doc_string(const nix::Value& v) const;
-        json complete_nix_expression(std::string_view code, int cursor_pos);
+        std::string get_doc_string(const nix::Value& v);
+        std::string print_value(const nix::Value& v, const print_limits& limits);
+        std::string describe_attr_path(const std::string& path, int detail_level);
+        json complete_nix_expression(std::string_view code, int cursor_pos, bool evaluate);
+        const attr_listing* lookup_attr_names(const std::string& path);
+        const name_list* lookup_completion_names(const std::string& path);
+        const name_list* cached_completion_names(const std::string& path) const;
+        const std::string* source_origin(std::string_view name);
+        flake_output_cache* flake_attr_path(const std::string& path, std::vector<nix::Symbol>& attr_path);
+        const doc_search_index& builtins_doc_index();
+        const doc_search_index& lambda_doc_index(const std::string& expr_str, nix::Value& v);
+        void initialize();
+        void prewarm(const std::string& expr);
+        // publishes the output that is due, on the evaluation thread while it works
+        void poll_output();
         void initialize_scope();
+        void load_file(loaded_file& file);
+        void bind_loaded_file(const loaded_file& file);
+        void record_session_command(std::string name, const std::string& arg);
+        void replay_session();
+
+        // builds, in the foreground or as background jobs
+        std::vector<build_target> eval_build_targets(const std::string& expr);
+        void build_batch(std::vector<build_target>& targets, bool create_roots);
+        void start_build_job(const nix::StorePath& drv_path, bool create_roots);
+        kj::Promise<void> run_build_job(size_t id, nix::StorePath drv_path, bool create_roots);
+        void show_build_job(const build_job& job, bool update);
+        void refresh_build_jobs();
+        bool pump_build_jobs();
+        build_job& find_build_job(const std::string& arg);
 
         // REPL command handlers
         using repl_command_handler = void (interpreter::*)(const std::string&);
@@ -82,21 +195,131 @@ namespace xeus_lix
         void repl_print(const std::string& arg);
         void repl_log(const std::string& arg);
         void repl_trace_enable(const std::string& arg);
+        void repl_stats(const std::string& arg);
+        void repl_search(const std::string& arg);
+        void repl_apropos(const std::string& arg);
+        void repl_jobs(const std::string& arg);
+        void repl_wait(const std::string& arg);
+        void repl_kill(const std::string& arg);
 
-        // lix evaluation state
+        // the thread every request that touches lix runs on
+        eval_worker& m_worker;
+        // cells waiting for it, in order; each has a job of its own on the worker that runs
+        // whichever cell is first by then, so aborting one is taking it out of here
+        std::mutex m_cells_mutex;
+        std::deque<queued_cell> m_cells;
+        // (message type, content) published on the evaluation thread between requests
+        std::vector<std::pair<std::string, json>> m_held_output;
+
+        // lix evaluation state, null until initialize() ran
         std::unique_ptr<nix::AsyncIoRoot> m_aio;
-        nix::ref<nix::Store> m_store;
+        std::shared_ptr<nix::Store> m_store;
         std::unique_ptr<nix::Evaluator> m_evaluator;
-        nix::box_ptr<nix::EvalState> m_evalState;
-        nix::Env* m_localEnv;
-        std::shared_ptr<nix::StaticEnv> m_staticEnv;
-        int m_displacement;
-        std::unique_ptr<nix::Logger> m_logger;
-        std::vector<std::string> m_loaded_files;
-
-        // the maximum number of variables (8MiB) that can be stored in the REPL environment
-        // https://git.lix.systems/lix-project/lix/src/commit/ae00b1298353a43a10bbecea8220471731db10ec/lix/libcmd/repl.cc#L127
-        static const size_t NIX_ENV_SIZE = 1 << 20;
+        std::optional<nix::box_ptr<nix::EvalState>> m_evalStateBox;
+        nix::EvalState* m_evalState = nullptr;
+        // set once initialize() succeeded; until then requests that need lix queue behind
+        // it or are answered without it, and if it failed cells report m_init_error
+        std::atomic<bool> m_ready = false;
+        std::string m_init_error;
+        std::string m_prewarm;
+        // an execute request interrupts the prewarm expression instead of waiting for it
+        std::atomic<bool> m_prewarming = false;
+        std::unique_ptr<repl_scope> m_scope;
+        std::unique_ptr<stream_buffer> m_streams;
+        std::unique_ptr<JupyterLogger> m_logger;
+        // cancelled by an interrupt, reset at the start of every request
+        std::unique_ptr<cancellation_token> m_cancel;
+        // in the order they were loaded, which is the order `:reload` binds them in again
+        std::vector<loaded_file> m_loaded_files;
+        std::unique_ptr<file_watch> m_file_watch;
+
+        // set up by `--replay-session`, null otherwise
+        std::unique_ptr<session_manifest> m_session;
+        // output is dropped while the kernel sets itself up, replays the previous session
+        // or prewarms: no request asked for it
+        std::atomic<bool> m_quiet = false;
+        // until then, completion offers the names an earlier session indexed for the
+        // store sources being loaded, by the top-level name each source binds
+        std::unordered_map<std::string_view, std::shared_ptr<const std::string>> m_replay_origins;
+        // what went wrong, told with the next cell
+        std::vector<std::string> m_replay_errors;
+        std::vector<loaded_source> m_loaded_sources;
+        // flakes loaded with `:lf`, whose outputs are looked up through lix's evaluation cache
+        std::vector<std::unique_ptr<flake_output_cache>> m_flakes;
+
+        // bumped whenever m_scope changes, which invalidates everything bound against it
+        uint64_t m_scope_generation;
+        // completion reads the symbol index and the attribute cache from the shell thread
+        // while a cell runs; the evaluation thread holds this exclusively to change them
+        mutable std::shared_mutex m_names_mutex;
+        std::unique_ptr<parse_cache> m_parse_cache;
+        std::unique_ptr<attr_name_cache> m_attr_cache;
+        std::unique_ptr<symbol_index> m_symbol_index;
+        std::unique_ptr<persistent_attr_index> m_attr_index;
+        // `:search` indexes by the expression they were built for
+        std::map<std::string, std::unique_ptr<package_search_index>> m_search_indexes;
+        // `:apropos` indexes, built on first use
+        std::unique_ptr<doc_search_index> m_builtins_docs;
+        std::map<std::string, std::unique_ptr<doc_search_index>> m_doc_indexes;
+        // what `get_doc_string` returns for lambdas and for builtins
+        std::unique_ptr<doc_comment_cache> m_doc_cache;
+        std::unordered_map<std::string, std::string> m_builtin_doc_markdown;
+        // what `:log` fetched, by derivation path
+        std::unique_ptr<build_log_cache> m_build_logs;
+        // the rest of the last value whose printing stopped, for `:p --more`
+        std::unique_ptr<value_printer> m_print_continuation;
+        // `:b <expr> &` builds by job number; declared after the store so they go first
+        std::map<size_t, std::unique_ptr<build_job>> m_build_jobs;
+        size_t m_next_build_job = 1;
+        std::chrono::steady_clock::time_point m_build_jobs_shown;
+
+        // counters reported by `:stats`
+        struct kernel_stats
+        {
+            size_t parses = 0;
+            size_t parse_cache_hits = 0;
+            size_t parse_cache_misses = 0;
+            size_t attr_cache_hits = 0;
+            size_t attr_cache_misses = 0;
+            size_t attr_index_hits = 0;
+            size_t replayed_commands = 0;
+            size_t replay_commands = 0;
+            std::chrono::milliseconds replay_time{ 0 };
+            // from the start of the kernel to lix being ready, and the prewarm expression
+            std::chrono::milliseconds startup_time{ 0 };
+            std::chrono::milliseconds prewarm_time{ 0 };
+            std::string prewarm_outcome;
+        };
+        kernel_stats m_stats;
+        std::chrono::steady_clock::time_point m_started;
+        // how long after the start the first completion request got an answer with
+        // matches, in milliseconds; -1 until then
+        std::atomic<int64_t> m_first_completion_ms = -1;
+
+        // number of distinct inputs whose parse results are kept around
+        static const size_t PARSE_CACHE_SIZE = 64;
+
+        // upper bound on the number of ranked completions returned for one request
+        static const size_t MAX_COMPLETIONS = 200;
+
+        // how long one `:search` may spend walking packages before showing what it has
+        static constexpr std::chrono::seconds SEARCH_TIME_BUDGET{ 30 };
+        // upper bound on the number of `:search` results shown
+        static constexpr size_t MAX_SEARCH_RESULTS = 100;
+
+        // how long an inspect request may evaluate before it reports an unevaluated thunk
+        static constexpr std::chrono::milliseconds INSPECT_TIME_BUDGET{ 100 };
+
+        // how deep `:apropos` looks for documented functions below the searched set
+        static constexpr unsigned APROPOS_MAX_DEPTH = 2;
+        // upper bound on the number of `:apropos` hits shown
+        static constexpr size_t MAX_APROPOS_RESULTS = 20;
+
+        // how long the idle evaluation thread turns the event loop for background builds
+        // before it looks for new requests again
+        static constexpr std::chrono::milliseconds BUILD_JOB_PUMP_INTERVAL{ 25 };
+        // how often the output of a running background build is updated
+        static constexpr std::chrono::seconds BUILD_JOB_REFRESH_INTERVAL{ 1 };
     };
 }
 
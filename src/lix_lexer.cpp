@@ -0,0 +1,385 @@
+#include "lix_lexer.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace xeus_lix
+{
+    namespace
+    {
+        bool is_ident_start(char c)
+        {
+            return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+        }
+
+        bool is_ident_char(char c)
+        {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '\'' || c == '-';
+        }
+
+        bool is_digit(char c)
+        {
+            return std::isdigit(static_cast<unsigned char>(c));
+        }
+
+        bool is_path_char(char c)
+        {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '_' || c == '-' || c == '+';
+        }
+
+        bool is_uri_char(char c)
+        {
+            return c != '\0' && (std::isalnum(static_cast<unsigned char>(c)) || std::strchr("%/?:@&=+$,-_.!~*'", c));
+        }
+
+        // longest operators first, so that e.g. `...` wins over `.`
+        constexpr std::string_view s_multi_char_ops[] = {
+            "...", "++", "//", "==", "!=", "<=", ">=", "&&", "||", "->", "|>", "<|",
+        };
+    }
+
+    bool is_attr_path(std::string_view s)
+    {
+        return !s.empty() && s.front() != '.' && s.back() != '.'
+            && std::all_of(s.begin(), s.end(), [](char c) { return is_ident_char(c) || c == '.'; });
+    }
+
+    lexer::lexer(const std::string_view source)
+        : m_src(source)
+        , m_pos(0)
+    {
+    }
+
+    void lexer::seek(size_t offset)
+    {
+        m_pos = std::min(offset, m_src.size());
+    }
+
+    char lexer::peek(size_t ahead) const
+    {
+        return m_pos + ahead < m_src.size() ? m_src[m_pos + ahead] : '\0';
+    }
+
+    bool lexer::looking_at(std::string_view s) const
+    {
+        return m_src.substr(m_pos, s.size()) == s;
+    }
+
+    void lexer::advance(size_t n)
+    {
+        m_pos = std::min(m_pos + n, m_src.size());
+    }
+
+    token lexer::next()
+    {
+        token tok;
+        tok.newline_before = skip_trivia(tok.unterminated);
+        tok.offset = m_pos;
+        if (m_pos >= m_src.size())
+        {
+            tok.kind = token_kind::eof;
+            return tok;
+        }
+
+        const size_t start = m_pos;
+        const char c = m_src[m_pos];
+        if (c == '"')
+        {
+            tok.kind = token_kind::string;
+            tok.unterminated = !skip_string();
+        }
+        else if (c == '\'' && peek(1) == '\'')
+        {
+            tok.kind = token_kind::string;
+            tok.unterminated = !skip_indented_string();
+        }
+        else if (size_t end = match_search_path(m_pos))
+        {
+            tok.kind = token_kind::path;
+            m_pos = end;
+        }
+        else if (size_t end = match_path(m_pos))
+        {
+            tok.kind = token_kind::path;
+            m_pos = end;
+        }
+        else if (size_t end = match_uri(m_pos))
+        {
+            tok.kind = token_kind::uri;
+            m_pos = end;
+        }
+        else if (is_ident_start(c))
+        {
+            tok.kind = token_kind::identifier;
+            while (m_pos < m_src.size() && is_ident_char(m_src[m_pos]))
+            {
+                ++m_pos;
+            }
+        }
+        else if (is_digit(c) || (c == '.' && is_digit(peek(1))))
+        {
+            tok.kind = token_kind::number;
+            while (m_pos < m_src.size() && (is_digit(m_src[m_pos]) || m_src[m_pos] == '.'))
+            {
+                ++m_pos;
+            }
+            if (m_pos < m_src.size() && (m_src[m_pos] == 'e' || m_src[m_pos] == 'E'))
+            {
+                size_t exp = m_pos + 1;
+                if (exp < m_src.size() && (m_src[exp] == '+' || m_src[exp] == '-'))
+                {
+                    ++exp;
+                }
+                if (exp < m_src.size() && is_digit(m_src[exp]))
+                {
+                    m_pos = exp;
+                    while (m_pos < m_src.size() && is_digit(m_src[m_pos]))
+                    {
+                        ++m_pos;
+                    }
+                }
+            }
+        }
+        else
+        {
+            tok.kind = token_kind::punct;
+            auto op = std::find_if(std::begin(s_multi_char_ops), std::end(s_multi_char_ops), [&](std::string_view o) {
+                return looking_at(o);
+            });
+            advance(op != std::end(s_multi_char_ops) ? op->size() : 1);
+        }
+
+        tok.text = m_src.substr(start, m_pos - start);
+        return tok;
+    }
+
+    // skips whitespace and comments, returns whether a line break was crossed
+    bool lexer::skip_trivia(bool& unterminated)
+    {
+        bool newline = false;
+        while (m_pos < m_src.size())
+        {
+            const char c = m_src[m_pos];
+            if (c == '\n')
+            {
+                newline = true;
+                ++m_pos;
+            }
+            else if (c == ' ' || c == '\t' || c == '\r')
+            {
+                ++m_pos;
+            }
+            else if (c == '#')
+            {
+                size_t eol = m_src.find('\n', m_pos);
+                m_pos = eol == std::string_view::npos ? m_src.size() : eol;
+            }
+            else if (c == '/' && peek(1) == '*')
+            {
+                size_t close = m_src.find("*/", m_pos + 2);
+                size_t end = close == std::string_view::npos ? m_src.size() : close + 2;
+                if (m_src.substr(m_pos, end - m_pos).find('\n') != std::string_view::npos)
+                {
+                    newline = true;
+                }
+                if (close == std::string_view::npos)
+                {
+                    unterminated = true;
+                }
+                m_pos = end;
+            }
+            else
+            {
+                break;
+            }
+        }
+        return newline;
+    }
+
+    // "..." with escapes and ${} interpolations, returns false if unterminated
+    bool lexer::skip_string()
+    {
+        advance(1);
+        while (m_pos < m_src.size())
+        {
+            if (looking_at("\\"))
+            {
+                advance(2);
+            }
+            else if (looking_at("\""))
+            {
+                advance(1);
+                return true;
+            }
+            else if (looking_at("${"))
+            {
+                advance(2);
+                if (!skip_interpolation())
+                {
+                    return false;
+                }
+            }
+            else if (looking_at("$$"))
+            {
+                advance(2);
+            }
+            else
+            {
+                advance(1);
+            }
+        }
+        return false;
+    }
+
+    // ''...'' with its ''-escapes and ${} interpolations, returns false if unterminated
+    bool lexer::skip_indented_string()
+    {
+        advance(2);
+        while (m_pos < m_src.size())
+        {
+            if (looking_at("'''") || looking_at("''$"))
+            {
+                advance(3);
+            }
+            else if (looking_at("''\\"))
+            {
+                advance(4);
+            }
+            else if (looking_at("''"))
+            {
+                advance(2);
+                return true;
+            }
+            else if (looking_at("${"))
+            {
+                advance(2);
+                if (!skip_interpolation())
+                {
+                    return false;
+                }
+            }
+            else if (looking_at("$$"))
+            {
+                advance(2);
+            }
+            else
+            {
+                advance(1);
+            }
+        }
+        return false;
+    }
+
+    // skips the body of a ${...} up to and including the matching `}`
+    bool lexer::skip_interpolation()
+    {
+        int depth = 0;
+        while (true)
+        {
+            token tok = next();
+            if (tok.kind == token_kind::eof || tok.unterminated)
+            {
+                return false;
+            }
+            if (tok.is("{"))
+            {
+                ++depth;
+            }
+            else if (tok.is("}"))
+            {
+                if (depth == 0)
+                {
+                    return true;
+                }
+                --depth;
+            }
+        }
+    }
+
+    // <nixpkgs>, <nixpkgs/lib>; returns the end offset or 0 if there is no match
+    size_t lexer::match_search_path(size_t pos) const
+    {
+        if (pos >= m_src.size() || m_src[pos] != '<')
+        {
+            return 0;
+        }
+        size_t i = pos + 1;
+        size_t segment_start = i;
+        while (i < m_src.size())
+        {
+            if (is_path_char(m_src[i]))
+            {
+                ++i;
+            }
+            else if (m_src[i] == '/' && i > segment_start)
+            {
+                segment_start = ++i;
+            }
+            else
+            {
+                break;
+            }
+        }
+        if (i == segment_start || i >= m_src.size() || m_src[i] != '>')
+        {
+            return 0;
+        }
+        return i + 1;
+    }
+
+    // ./foo, ../foo, /abs, foo/bar and ~/foo; returns the end offset or 0 if there is no match
+    size_t lexer::match_path(size_t pos) const
+    {
+        size_t i = pos;
+        if (i < m_src.size() && m_src[i] == '~')
+        {
+            ++i;
+            if (i >= m_src.size() || m_src[i] != '/')
+            {
+                return 0;
+            }
+        }
+        while (i < m_src.size() && is_path_char(m_src[i]))
+        {
+            ++i;
+        }
+        size_t end = 0;
+        while (i + 1 < m_src.size() && m_src[i] == '/' && is_path_char(m_src[i + 1]))
+        {
+            ++i;
+            while (i < m_src.size() && is_path_char(m_src[i]))
+            {
+                ++i;
+            }
+            end = i;
+        }
+        return end;
+    }
+
+    // scheme:rest as accepted by the nix lexer; returns the end offset or 0 if there is no match
+    size_t lexer::match_uri(size_t pos) const
+    {
+        if (pos >= m_src.size() || !std::isalpha(static_cast<unsigned char>(m_src[pos])))
+        {
+            return 0;
+        }
+        size_t i = pos + 1;
+        while (i < m_src.size()
+               && (std::isalnum(static_cast<unsigned char>(m_src[i])) || m_src[i] == '+' || m_src[i] == '-'
+                   || m_src[i] == '.'))
+        {
+            ++i;
+        }
+        if (i + 1 >= m_src.size() || m_src[i] != ':' || !is_uri_char(m_src[i + 1]))
+        {
+            return 0;
+        }
+        i += 1;
+        while (i < m_src.size() && is_uri_char(m_src[i]))
+        {
+            ++i;
+        }
+        return i;
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef XEUS_LIX_LEXER_HPP
+#define XEUS_LIX_LEXER_HPP
+
+#include <cstddef>
+#include <string_view>
+
+namespace xeus_lix
+{
+    enum class token_kind
+    {
+        identifier, // identifiers and keywords
+        number,
+        path,       // ./foo, /abs/path, ~/x, <nixpkgs>
+        uri,        // https://example.org, also `x:y` as the nix lexer reads it
+        string,     // "..." and ''...'' including any interpolations
+        punct,      // operators and brackets
+        eof
+    };
+
+    struct token
+    {
+        token_kind kind = token_kind::eof;
+        std::string_view text;
+        size_t offset = 0;
+        // a line break separates this token from the previous one
+        bool newline_before = false;
+        // a string or block comment ran into the end of the input
+        bool unterminated = false;
+
+        bool is(std::string_view s) const
+        {
+            return (kind == token_kind::identifier || kind == token_kind::punct) && text == s;
+        }
+    };
+
+    // whether `s` is a plain attribute path such as `pkgs` or `pkgs.lib.strings`, which
+    // can be looked up without running arbitrary code
+    bool is_attr_path(std::string_view s);
+
+    // a small, error-tolerant tokenizer for nix source text
+    // it is used where running the lix parser would be too expensive or too strict
+    // (splitting cells, completion context), so it never throws: malformed input
+    // degrades to punctuation tokens and unterminated strings or comments are
+    // reported through `token::unterminated`
+    class lexer
+    {
+    public:
+        explicit lexer(std::string_view source);
+
+        token next();
+        void seek(size_t offset);
+        size_t offset() const { return m_pos; }
+
+    private:
+        bool skip_trivia(bool& unterminated);
+        bool skip_string();
+        bool skip_indented_string();
+        bool skip_interpolation();
+        size_t match_search_path(size_t pos) const;
+        size_t match_path(size_t pos) const;
+        size_t match_uri(size_t pos) const;
+
+        char peek(size_t ahead) const;
+        bool looking_at(std::string_view s) const;
+        void advance(size_t n);
+
+        std::string_view m_src;
+        size_t m_pos;
+    };
+}
+
+#endif
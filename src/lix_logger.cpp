@@ -1,5 +1,7 @@
 #include "lix_logger.hpp"
 
+#include <unistd.h>
+
 namespace xeus_lix
 {
     JupyterLogger::JupyterLogger(interpreter* interp)
@@ -31,24 +33,100 @@ namespace xeus_lix
         p_interpreter->publish_stream("stderr", oss.str());
     }
 
-    // we don't need the following methods for now
-
     void JupyterLogger::startActivity(
-        nix::ActivityId,
+        nix::ActivityId act,
         nix::Verbosity,
-        nix::ActivityType,
-        const std::string&,
-        const Fields&,
+        nix::ActivityType type,
+        const std::string& s,
+        const Fields& fields,
         nix::ActivityId
     )
     {
+        std::lock_guard lock(m_mutex);
+        m_activities.start(act, type, s, fields);
+        m_dirty.store(true, std::memory_order_relaxed);
+    }
+
+    void JupyterLogger::stopActivity(nix::ActivityId act)
+    {
+        std::lock_guard lock(m_mutex);
+        m_activities.stop(act);
+        m_dirty.store(true, std::memory_order_relaxed);
+    }
+
+    void JupyterLogger::result(nix::ActivityId act, nix::ResultType type, const Fields& fields)
+    {
+        std::lock_guard lock(m_mutex);
+        m_activities.result(act, type, fields);
+        m_dirty.store(true, std::memory_order_relaxed);
+    }
+
+    void JupyterLogger::begin_cell()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_activities.reset_totals();
+        }
+        m_display_id.clear();
+        m_dirty.store(false, std::memory_order_relaxed);
+        m_in_cell = true;
+    }
+
+    void JupyterLogger::end_cell()
+    {
+        if (m_in_cell && m_dirty.load(std::memory_order_relaxed))
+        {
+            render();
+        }
+        m_in_cell = false;
     }
 
-    void JupyterLogger::stopActivity(nix::ActivityId)
+    void JupyterLogger::flush_if_due()
     {
+        if (!m_in_cell || !m_dirty.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+        if (std::chrono::steady_clock::now() - m_rendered >= PROGRESS_RENDER_INTERVAL)
+        {
+            render();
+        }
     }
 
-    void JupyterLogger::result(nix::ActivityId, nix::ResultType, const Fields&)
+    std::string JupyterLogger::build_progress(const std::string& drv_path)
     {
+        std::lock_guard lock(m_mutex);
+        return m_activities.render_build(drv_path);
+    }
+
+    void JupyterLogger::render()
+    {
+        m_dirty.store(false, std::memory_order_relaxed);
+        m_rendered = std::chrono::steady_clock::now();
+        std::string text;
+        {
+            std::lock_guard lock(m_mutex);
+            text = m_activities.render();
+        }
+        if (m_display_id.empty() && text.empty())
+        {
+            return;
+        }
+
+        nl::json bundle;
+        bundle["text/plain"] = std::move(text);
+        nl::json transient;
+        if (m_display_id.empty())
+        {
+            // display ids are global to the notebook, so they must not repeat across kernel restarts
+            m_display_id = "xeus-lix-progress-" + std::to_string(::getpid()) + "-" + std::to_string(++m_displays);
+            transient["display_id"] = m_display_id;
+            p_interpreter->display_data(std::move(bundle), nl::json::object(), std::move(transient));
+        }
+        else
+        {
+            transient["display_id"] = m_display_id;
+            p_interpreter->update_display_data(std::move(bundle), nl::json::object(), std::move(transient));
+        }
     }
 }
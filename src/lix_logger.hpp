@@ -1,10 +1,15 @@
 #ifndef XEUS_LIX_LOGGER_HPP
 #define XEUS_LIX_LOGGER_HPP
 
+#include "lix_activity_tree.hpp"
 #include "lix_interpreter.hpp"
 #include "lix/libutil/error.hh"
 #include "lix/libutil/logging.hh"
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
 #include <string_view>
 
 namespace xeus_lix
@@ -19,14 +24,46 @@ namespace xeus_lix
         // redirects structured error info
         void logEI(const nix::ErrorInfo& ei) override;
 
-        // the following are part of the nix::Logger interface but not implemented yet
+        // builds, substitutions and downloads are tracked and shown as one progress
+        // display per cell, redrawn at most every PROGRESS_RENDER_INTERVAL. these only
+        // record what happened, whichever thread they are called on
         void startActivity(nix::ActivityId, nix::Verbosity, nix::ActivityType, const std::string&, const Fields&, nix::ActivityId)
             override;
         void stopActivity(nix::ActivityId) override;
         void result(nix::ActivityId, nix::ResultType, const Fields&) override;
 
+        // the methods below are for the evaluation thread, which is the only one that
+        // publishes a cell's output
+
+        // the next progress display goes into a new output; called when a cell starts
+        void begin_cell();
+        // draws whatever changed since the last redraw; nothing is drawn until the next
+        // cell begins, so work between cells does not end up in the last cell's output
+        void end_cell();
+        // redraws the cell's display if it changed and was not redrawn for a while
+        void flush_if_due();
+        // the phase and last log lines of the running build of `drv_path`, for the display
+        // of the background job building it
+        std::string build_progress(const std::string& drv_path);
+
     private:
+        void render();
+
         interpreter* p_interpreter;
+
+        // downloads report from their own thread
+        std::mutex m_mutex;
+        activity_tree m_activities;
+        std::atomic<bool> m_dirty = false;
+
+        // evaluation thread only
+        bool m_in_cell = false;
+        std::string m_display_id;
+        size_t m_displays = 0;
+        std::chrono::steady_clock::time_point m_rendered;
+
+        // a parallel build can log thousands of lines a second, the frontend sees a few redraws
+        static constexpr std::chrono::milliseconds PROGRESS_RENDER_INTERVAL{ 250 };
     };
 }
 
@@ -0,0 +1,76 @@
+#include "lix_parse_cache.hpp"
+
+#include "lix/libexpr/eval.hh"
+
+namespace xeus_lix
+{
+    parsed_input::parsed_input(repl_parse_result r)
+        : result(std::move(r))
+    {
+    }
+
+    parsed_input::~parsed_input()
+    {
+        if (!evaluated)
+        {
+            return;
+        }
+        std::visit(
+            nix::overloaded{
+                [](std::unique_ptr<nix::Expr>& expr) { (void)expr.release(); },
+                [](nix::ExprReplBindings& bindings) {
+                    for (auto& [name, expr] : bindings.symbols)
+                    {
+                        (void)expr.release();
+                    }
+                } },
+            result
+        );
+    }
+
+    parse_cache::parse_cache(size_t capacity)
+        : m_capacity(capacity)
+    {
+    }
+
+    parse_cache::key parse_cache::make_key(std::string_view code, uint64_t generation)
+    {
+        return key{ std::hash<std::string_view>{}(code), generation };
+    }
+
+    std::shared_ptr<parsed_input> parse_cache::find(std::string_view code, uint64_t generation)
+    {
+        auto [first, last] = m_index.equal_range(make_key(code, generation));
+        for (auto it = first; it != last; ++it)
+        {
+            if (it->second->code == code)
+            {
+                m_entries.splice(m_entries.begin(), m_entries, it->second);
+                return it->second->parsed;
+            }
+        }
+        return nullptr;
+    }
+
+    void parse_cache::insert(std::string code, uint64_t generation, std::shared_ptr<parsed_input> parsed)
+    {
+        key k = make_key(code, generation);
+        m_entries.push_front(entry{ std::move(code), generation, std::move(parsed) });
+        m_index.emplace(k, m_entries.begin());
+
+        while (m_entries.size() > m_capacity)
+        {
+            auto victim = std::prev(m_entries.end());
+            auto [first, last] = m_index.equal_range(make_key(victim->code, victim->generation));
+            for (auto it = first; it != last; ++it)
+            {
+                if (it->second == victim)
+                {
+                    m_index.erase(it);
+                    break;
+                }
+            }
+            m_entries.pop_back();
+        }
+    }
+}
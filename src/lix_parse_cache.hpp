@@ -0,0 +1,74 @@
+#ifndef XEUS_LIX_PARSE_CACHE_HPP
+#define XEUS_LIX_PARSE_CACHE_HPP
+
+#include "lix/libexpr/nixexpr.hh"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+
+namespace xeus_lix
+{
+    // what the lix REPL parser produces for a piece of input
+    using repl_parse_result = std::variant<std::unique_ptr<nix::Expr>, nix::ExprReplBindings>;
+
+    // a parse result shared between the requests that need it. once an expression has
+    // been evaluated, thunks may point into it, so it is deliberately leaked instead of
+    // freed when the last reference goes away (the same thing the REPL always did)
+    struct parsed_input
+    {
+        explicit parsed_input(repl_parse_result r);
+        ~parsed_input();
+
+        repl_parse_result result;
+        bool evaluated = false;
+    };
+
+    // a small LRU cache of parse results keyed by the input text and the generation of
+    // the static environment it was bound against. parsing resolves variables to env
+    // displacements, so any change to the scope bumps the generation and makes all
+    // older entries unreachable; they then age out of the LRU
+    class parse_cache
+    {
+    public:
+        explicit parse_cache(size_t capacity);
+
+        std::shared_ptr<parsed_input> find(std::string_view code, uint64_t generation);
+        void insert(std::string code, uint64_t generation, std::shared_ptr<parsed_input> parsed);
+        size_t size() const { return m_entries.size(); }
+
+    private:
+        struct entry
+        {
+            std::string code;
+            uint64_t generation;
+            std::shared_ptr<parsed_input> parsed;
+        };
+        using entry_list = std::list<entry>;
+
+        struct key
+        {
+            size_t hash;
+            uint64_t generation;
+            bool operator==(const key&) const = default;
+        };
+
+        struct key_hash
+        {
+            size_t operator()(const key& k) const { return k.hash ^ (k.generation * 0x9e3779b97f4a7c15ull); }
+        };
+
+        static key make_key(std::string_view code, uint64_t generation);
+
+        size_t m_capacity;
+        // most recently used first
+        entry_list m_entries;
+        std::unordered_multimap<key, entry_list::iterator, key_hash> m_index;
+    };
+}
+
+#endif
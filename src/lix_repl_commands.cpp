@@ -1,4 +1,25 @@
 #include "lix_interpreter.hpp"
+#include "lix_attr_index.hpp"
+#include "lix_build_jobs.hpp"
+#include "lix_build_log.hpp"
+#include "lix_cancellation.hpp"
+#include "lix_doc_cache.hpp"
+#include "lix_doc_index.hpp"
+#include "lix_file_watch.hpp"
+#include "lix_flake_cache.hpp"
+#include "lix_logger.hpp"
+#include "lix_repl_scope.hpp"
+#include "lix_search_index.hpp"
+#include "lix_server.hpp"
+#include "lix_session.hpp"
+#include "lix_stream_buffer.hpp"
+#include "lix_value_printer.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <unistd.h>
 
 #include "lix/config.h"
 #include "lix/libcmd/common-eval-args.hh"
@@ -10,6 +31,7 @@
 #include "lix/libexpr/get-drvs.hh"
 #include "lix/libexpr/print.hh"
 #include "lix/libexpr/value.hh"
+#include "lix/libstore/build-result.hh"
 #include "lix/libstore/globals.hh"
 #include "lix/libstore/local-fs-store.hh"
 #include "lix/libstore/log-store.hh"
@@ -19,6 +41,21 @@
 
 namespace xeus_lix
 {
+    namespace
+    {
+        // `:b <expr> &` builds in the background; strips the `&` and says whether it was there
+        bool take_background_marker(std::string& arg)
+        {
+            size_t end = arg.find_last_not_of(" \t\r\n");
+            if (end == std::string::npos || arg[end] != '&' || (end > 0 && arg[end - 1] == '&'))
+            {
+                return false;
+            }
+            arg = nix::trim(arg.substr(0, end));
+            return true;
+        }
+    }
+
     const std::map<std::string, interpreter::repl_command_handler> interpreter::s_repl_commands = {
         { ":doc", &interpreter::repl_doc },
         { ":t", &interpreter::repl_type },
@@ -40,6 +77,12 @@ namespace xeus_lix
         { ":log", &interpreter::repl_log },
         { ":te", &interpreter::repl_trace_enable },
         { ":trace-enable", &interpreter::repl_trace_enable },
+        { ":stats", &interpreter::repl_stats },
+        { ":search", &interpreter::repl_search },
+        { ":apropos", &interpreter::repl_apropos },
+        { ":jobs", &interpreter::repl_jobs },
+        { ":wait", &interpreter::repl_wait },
+        { ":kill", &interpreter::repl_kill },
     };
 
     void interpreter::handle_repl_command(const std::string& command_line)
@@ -89,6 +132,15 @@ namespace xeus_lix
     // :t <expr> - Describe result of evaluation
     void interpreter::repl_type(const std::string& arg)
     {
+        std::vector<nix::Symbol> attr_path;
+        if (auto flake = flake_attr_path(arg, attr_path))
+        {
+            if (auto type = flake->type_of(*m_evalState, attr_path))
+            {
+                publish_stream("stdout", *type + "\n");
+                return;
+            }
+        }
         nix::Value v(nix::Value::null_t{});
         eval_pure_expression(arg, v);
         publish_stream("stdout", nix::showType(v) + "\n");
@@ -97,17 +149,162 @@ namespace xeus_lix
     // :load <path> - Load Nix expression and add it to scope
     void interpreter::repl_load(const std::string& arg)
     {
-        auto path = m_aio->blockOn(nix::lookupFileArg(*m_evaluator, arg)).unwrap();
-        nix::Value v(nix::Value::null_t{}), v_autocalled(nix::Value::null_t{});
+        auto path = block_on(*m_aio, *m_cancel, nix::lookupFileArg(*m_evaluator, arg)).unwrap();
+        loaded_file file;
+        file.path = path.to_string();
+        load_file(file);
+        bind_loaded_file(file);
+        m_loaded_files.push_back(std::move(file));
+        record_session_command("load", m_loaded_files.back().path);
+    }
+
+    // evaluates `file` again, after noting what it depends on
+    void interpreter::load_file(loaded_file& file)
+    {
+        file.value = nullptr;
+        // the dependencies are hashed before they are read, so an edit made while the
+        // file evaluates is still seen by the next reload
+        file.dependencies.clear();
+        file.complete = source_dependencies(
+            file.path,
+            [this](const std::string& dep) { return m_store->isInStore(dep); },
+            MAX_TRACKED_DEPENDENCIES,
+            file.dependencies
+        );
+        for (const auto& dep : file.dependencies)
+        {
+            m_file_watch->track(dep);
+        }
+
+        auto path = block_on(*m_aio, *m_cancel, nix::lookupFileArg(*m_evaluator, file.path)).unwrap();
+        nix::Value v(nix::Value::null_t{});
+        nix::Value* v_autocalled = m_evaluator->mem.allocValue();
         m_evalState->evalFile(path, v);
         nix::Bindings* auto_args = m_evaluator->buildBindings(0).finish();
-        m_evalState->autoCallFunction(*auto_args, v, v_autocalled, nix::noPos);
-        m_evalState->forceAttrs(v_autocalled, nix::noPos, "while loading file attributes");
-        add_to_scope(*v_autocalled.attrs);
-        m_loaded_files.push_back(path.to_string());
+        m_evalState->autoCallFunction(*auto_args, v, *v_autocalled, nix::noPos);
+        m_evalState->forceAttrs(*v_autocalled, nix::noPos, "while loading file attributes");
+        file.value = nix::allocRootValue(v_autocalled);
+    }
+
+    void interpreter::bind_loaded_file(const loaded_file& file)
+    {
+        nix::Value& value = **file.value;
+        add_to_scope(*value.attrs);
+
+        // files in the store never change, so attribute names found below them can be
+        // remembered across sessions
+        std::error_code ec;
+        auto resolved = std::filesystem::canonical(file.path, ec);
+        if (!ec && m_store->isInStore(resolved.string()))
+        {
+            std::string origin = loaded_source_origin(resolved.string(), nix::settings.thisSystem.get());
+            // the top-level names, under the empty path, are what a replayed session
+            // completes from before the file is loaded again
+            std::vector<std::string_view> names;
+            names.reserve(value.attrs->size());
+            for (const auto& attr : *value.attrs)
+            {
+                names.push_back(m_evaluator->symbols[attr.name]);
+            }
+            std::sort(names.begin(), names.end());
+            std::unique_lock names_lock(m_names_mutex);
+            m_attr_index->record(origin, "", names);
+            names_lock.unlock();
+            m_loaded_sources.push_back({ .origin = std::move(origin), .value = file.value });
+        }
+    }
+
+    void interpreter::record_session_command(std::string name, const std::string& arg)
+    {
+        if (m_session && !m_quiet)
+        {
+            m_session->append(std::move(name), arg);
+        }
+    }
+
+    // runs the setup commands of the notebook's previous session, before any request
+    void interpreter::replay_session()
+    {
+        if (!m_ready || shutdown_requested())
+        {
+            return;
+        }
+        auto started = std::chrono::steady_clock::now();
+        nix::unsetUserInterruptRequest();
+        m_cancel->reset();
+        // a copy, the manifest does not change while its commands are replayed
+        auto commands = m_session->commands();
+
+        std::unique_lock names_lock(m_names_mutex);
+        for (const auto& command : commands)
+        {
+            std::error_code ec;
+            auto resolved = std::filesystem::canonical(command.arg, ec);
+            if (command.name != "load" || ec || !m_store->isInStore(resolved.string()))
+            {
+                continue;
+            }
+            auto origin = std::make_shared<const std::string>(loaded_source_origin(resolved.string(), nix::settings.thisSystem.get()));
+            if (auto names = m_attr_index->find(*origin, ""))
+            {
+                m_symbol_index->add(names->names);
+                for (auto name : names->names)
+                {
+                    m_replay_origins.insert_or_assign(name, origin);
+                }
+            }
+        }
+        names_lock.unlock();
+
+        m_quiet = true;
+        m_stats.replay_commands = commands.size();
+        for (const auto& command : commands)
+        {
+            try
+            {
+                m_cancel->check();
+                if (command.name == "load")
+                {
+                    repl_load(command.arg);
+                }
+                else if (command.name == "load-flake")
+                {
+                    repl_load_flake(command.arg);
+                }
+                else if (command.name == "add")
+                {
+                    repl_add(command.arg);
+                }
+                else
+                {
+                    continue;
+                }
+                ++m_stats.replayed_commands;
+            }
+            catch (const nix::Interrupted&)
+            {
+                m_replay_errors.push_back("interrupted");
+                break;
+            }
+            catch (const std::exception& e)
+            {
+                m_replay_errors.push_back(command.name + " " + command.arg + ": " + e.what());
+            }
+        }
+        m_quiet = false;
+
+        // what is bound now replaces the names that stood in for it
+        names_lock.lock();
+        m_replay_origins.clear();
+        m_symbol_index->clear_scope();
+        std::vector<std::string_view> bound;
+        m_scope->for_each([&](nix::Symbol name, nix::Value*) { bound.push_back(m_evaluator->symbols[name]); });
+        m_symbol_index->add(std::move(bound));
+        names_lock.unlock();
+        m_stats.replay_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
     }
 
-    // :reload - Reload all files
+    // :reload - Reload the files that changed and those depending on them
     void interpreter::repl_reload(const std::string& arg)
     {
         if (!arg.empty())
@@ -116,29 +313,55 @@ namespace xeus_lix
             return;
         }
         publish_stream("stdout", "Reloading environment...\n");
-        m_evalState->resetFileCache();
+        // what :lf and :a bound is gone after the reload, so it is not replayed either
+        if (m_session)
+        {
+            m_session->erase_if([](const session_manifest::command& command) { return command.name != "load"; });
+        }
 
-        initialize_scope();
+        // a file is evaluated again if anything it may have read changed, or if it is not
+        // known what it read or what it evaluated to; the others keep their values
+        std::set<std::string> changed = m_file_watch->changed();
+        std::vector<bool> stale;
+        for (const auto& file : m_loaded_files)
+        {
+            stale.push_back(!file.value || !file.complete
+                            || std::ranges::any_of(file.dependencies, [&](const std::string& dep) { return changed.contains(dep); }));
+        }
+        // lix cannot forget single files, and the changed ones may be imported anywhere
+        if (std::ranges::find(stale, true) != stale.end())
+        {
+            m_evalState->resetFileCache();
+        }
 
-        auto files_to_reload = m_loaded_files;
-        m_loaded_files.clear();
+        initialize_scope();
 
-        if (files_to_reload.empty())
+        if (m_loaded_files.empty())
         {
             publish_stream("stdout", "No files to reload.\n");
             return;
         }
 
-        for (const auto& path : files_to_reload)
+        // bound again in the order they were loaded, so later files still shadow earlier ones
+        for (size_t i = 0; i < m_loaded_files.size(); ++i)
         {
+            loaded_file& file = m_loaded_files[i];
+            if (!stale[i])
+            {
+                publish_stream("stdout", "Unchanged " + file.path + "\n");
+                bind_loaded_file(file);
+                continue;
+            }
             try
             {
-                publish_stream("stdout", "Reloading " + path + "\n");
-                repl_load(path);
+                publish_stream("stdout", "Reloading " + file.path + "\n");
+                load_file(file);
+                bind_loaded_file(file);
             }
             catch (const std::exception& e)
             {
-                publish_stream("stderr", "Failed to reload " + path + ": " + e.what() + "\n");
+                // kept, so it is tried again on the next reload
+                publish_stream("stderr", "Failed to reload " + file.path + ": " + e.what() + "\n");
             }
         }
     }
@@ -150,57 +373,230 @@ namespace xeus_lix
         eval_pure_expression(arg, v);
         m_evalState->forceAttrs(v, nix::noPos, "while evaluating attribute set for :add");
         add_to_scope(*v.attrs);
+        record_session_command("add", arg);
     }
 
-    // :b <expr> - Build a derivation
-    void interpreter::repl_build(const std::string& arg)
+    // the derivation `expr` evaluates to, or those in the list or attribute set it evaluates to
+    std::vector<build_target> interpreter::eval_build_targets(const std::string& expr)
     {
+        // a flake's packages usually have their derivation path in the evaluation cache
+        std::vector<nix::Symbol> attr_path;
+        if (auto flake = flake_attr_path(expr, attr_path))
+        {
+            if (auto drvPath = flake->derivation(*m_evalState, attr_path))
+            {
+                return { build_target{ .drv_path = m_store->printStorePath(*drvPath) } };
+            }
+        }
         nix::Value v(nix::Value::null_t{});
-        eval_pure_expression(arg, v);
-        auto drvInfo = nix::getDerivation(*m_evalState, v, false);
-        if (!drvInfo)
+        eval_pure_expression(expr, v);
+        if (auto drvInfo = nix::getDerivation(*m_evalState, v, false))
+        {
+            auto drvPath = drvInfo->queryDrvPath(*m_evalState);
+            if (!drvPath)
+            {
+                throw nix::Error("derivation is missing 'drvPath' attribute.");
+            }
+            return { build_target{ .drv_path = m_store->printStorePath(*drvPath) } };
+        }
+
+        m_evalState->forceValue(v, nix::noPos);
+        if (v.type() != nix::nList && v.type() != nix::nAttrs)
         {
-            throw nix::Error("expression does not evaluate to a derivation.");
+            throw nix::Error("expression does not evaluate to a derivation, or to a list or set of them.");
         }
-        auto drvPath = drvInfo->queryDrvPath(*m_evalState);
-        if (!drvPath)
+        // the same walk as `nix-build` does: the elements of a list, the attributes of a
+        // set, and below those only into sets with `recurseForDerivations`
+        nix::DrvInfos drvs;
+        nix::Bindings* auto_args = m_evaluator->buildBindings(0).finish();
+        nix::getDerivations(*m_evalState, v, "", *auto_args, drvs, false);
+        std::vector<build_target> targets;
+        for (auto& drv : drvs)
         {
-            throw nix::Error("derivation is missing 'drvPath' attribute.");
+            auto drvPath = drv.queryDrvPath(*m_evalState);
+            if (!drvPath)
+            {
+                throw nix::Error("derivation '%s' is missing 'drvPath' attribute.", drv.attrPath);
+            }
+            targets.push_back({ .name = drv.attrPath, .drv_path = m_store->printStorePath(*drvPath) });
         }
-        publish_stream("stdout", "Building " + m_store->printStorePath(*drvPath) + "\n");
-        m_aio->blockOn(m_store->buildPaths(
-            { nix::DerivedPath::Built{ .drvPath = nix::makeConstantStorePath(*drvPath), .outputs = nix::OutputsSpec::All{} } }
+        if (targets.empty())
+        {
+            throw nix::Error("expression does not contain any derivations.");
+        }
+        return targets;
+    }
+
+    // builds all `targets` with one call into the store, and records how each one went
+    // the store schedules them together under max-jobs, and with keep-going, which the
+    // kernel sets before it opens the store, a failed target does not stop the others.
+    // the table is shown either way and the cell only fails afterwards
+    void interpreter::build_batch(std::vector<build_target>& targets, bool create_roots)
+    {
+        std::vector<nix::DerivedPath> paths;
+        std::unordered_map<std::string, size_t> target_of;
+        for (size_t i = 0; i < targets.size(); ++i)
+        {
+            nix::DerivedPath path = nix::DerivedPath::Built{
+                .drvPath = nix::makeConstantStorePath(m_store->parseStorePath(targets[i].drv_path)),
+                .outputs = nix::OutputsSpec::All{},
+            };
+            target_of.emplace(path.to_string(*m_store), i);
+            paths.push_back(std::move(path));
+        }
+        publish_stream(
+            "stdout",
+            "Building " + std::to_string(targets.size()) + (targets.size() == 1 ? " derivation\n" : " derivations\n")
+        );
+
+        std::vector<std::optional<nix::KeyedBuildResult>> results(targets.size());
+        for (auto& result : block_on(*m_aio, *m_cancel, m_store->buildPathsWithResults(paths)))
+        {
+            if (auto it = target_of.find(result.path.to_string(*m_store)); it != target_of.end())
+            {
+                results[it->second] = std::move(result);
+            }
+        }
+
+        auto localStore = create_roots ? std::dynamic_pointer_cast<nix::LocalFSStore>(m_store) : nullptr;
+        if (create_roots && !localStore)
+        {
+            publish_stream(
+                "stderr",
+                "Warning: store is not a local filesystem store, cannot create GC roots in the working directory.\n"
+            );
+        }
+
+        size_t failed = 0;
+        for (size_t i = 0; i < targets.size(); ++i)
+        {
+            auto& target = targets[i];
+            if (!results[i])
+            {
+                target.result = build_target::outcome::failed;
+                target.message = "the store did not report on this derivation";
+                ++failed;
+                continue;
+            }
+            const auto& result = *results[i];
+            switch (result.status)
+            {
+            case nix::BuildResult::Built:
+                target.result = build_target::outcome::built;
+                break;
+            case nix::BuildResult::Substituted:
+                target.result = build_target::outcome::substituted;
+                break;
+            case nix::BuildResult::AlreadyValid:
+            case nix::BuildResult::ResolvesToAlreadyValid:
+                target.result = build_target::outcome::valid;
+                break;
+            default:
+                target.result = build_target::outcome::failed;
+                target.message = result.errorMsg.empty() ? "build failed" : result.errorMsg;
+                ++failed;
+                continue;
+            }
+
+            auto drvPath = m_store->parseStorePath(target.drv_path);
+            for (auto& [outputName, outputPath] : block_on(*m_aio, *m_cancel, m_store->queryDerivationOutputMap(drvPath)))
+            {
+                if (!localStore)
+                {
+                    target.message += outputName + " -> " + m_store->printStorePath(outputPath) + "\n";
+                    continue;
+                }
+                // `nix build` numbers the links of several installables; names read better here
+                std::string symlink = "result-" + target.name + "-" + outputName;
+                try
+                {
+                    block_on(*m_aio, *m_cancel, localStore->addPermRoot(outputPath, nix::absPath(symlink)));
+                    target.message += "./" + symlink + " -> " + m_store->printStorePath(outputPath) + "\n";
+                }
+                catch (const std::exception& e)
+                {
+                    publish_stream("stderr", "Could not create symlink '" + symlink + "': " + e.what() + "\n");
+                }
+            }
+        }
+
+        nl::json bundle;
+        bundle["text/markdown"] = describe(targets);
+        display_data(std::move(bundle), nl::json::object(), nl::json::object());
+
+        if (failed > 0)
+        {
+            for (const auto& target : targets)
+            {
+                if (target.result == build_target::outcome::failed)
+                {
+                    publish_stream("stderr", target.name + ": " + target.message + "\n");
+                }
+            }
+            throw nix::Error("%d of %d derivations failed to build", failed, targets.size());
+        }
+    }
+
+    // :b <expr> [&] - Build a derivation, or a list or set of them, in the background with a trailing `&`
+    void interpreter::repl_build(const std::string& arg)
+    {
+        std::string expr = arg;
+        bool background = take_background_marker(expr);
+        auto targets = eval_build_targets(expr);
+        if (background)
+        {
+            for (const auto& target : targets)
+            {
+                start_build_job(m_store->parseStorePath(target.drv_path), false);
+            }
+            return;
+        }
+        if (targets.size() > 1 || !targets.front().name.empty())
+        {
+            build_batch(targets, false);
+            return;
+        }
+
+        auto drvPath = m_store->parseStorePath(targets.front().drv_path);
+        publish_stream("stdout", "Building " + targets.front().drv_path + "\n");
+        block_on(*m_aio, *m_cancel, m_store->buildPaths(
+            { nix::DerivedPath::Built{ .drvPath = nix::makeConstantStorePath(drvPath), .outputs = nix::OutputsSpec::All{} } }
         ));
         publish_stream("stdout", "\nThis derivation produced the following outputs:");
-        for (auto& [outputName, outputPath] : m_aio->blockOn(m_store->queryDerivationOutputMap(*drvPath)))
+        for (auto& [outputName, outputPath] : block_on(*m_aio, *m_cancel, m_store->queryDerivationOutputMap(drvPath)))
         {
             publish_stream("stdout", "\n  " + outputName + " -> " + m_store->printStorePath(outputPath));
         }
         publish_stream("stdout", "\n");
     }
 
-    // :bl <expr> - Build a derivation, creating GC roots in the working directory
+    // :bl <expr> [&] - Build a derivation, or a list or set of them, creating GC roots in the working directory
     void interpreter::repl_build_local(const std::string& arg)
     {
-        nix::Value v(nix::Value::null_t{});
-        eval_pure_expression(arg, v);
-        auto drvInfo = nix::getDerivation(*m_evalState, v, false);
-        if (!drvInfo)
+        std::string expr = arg;
+        bool background = take_background_marker(expr);
+        auto targets = eval_build_targets(expr);
+        if (background)
         {
-            throw nix::Error("expression does not evaluate to a derivation.");
+            for (const auto& target : targets)
+            {
+                start_build_job(m_store->parseStorePath(target.drv_path), true);
+            }
+            return;
         }
-        auto drvPath = drvInfo->queryDrvPath(*m_evalState);
-        if (!drvPath)
+        if (targets.size() > 1 || !targets.front().name.empty())
         {
-            throw nix::Error("derivation is missing 'drvPath' attribute.");
+            build_batch(targets, true);
+            return;
         }
 
-        publish_stream("stdout", "Building " + m_store->printStorePath(*drvPath) + "\n");
-        m_aio->blockOn(m_store->buildPaths(
-            { nix::DerivedPath::Built{ .drvPath = nix::makeConstantStorePath(*drvPath), .outputs = nix::OutputsSpec::All{} } }
+        auto drvPath = m_store->parseStorePath(targets.front().drv_path);
+        publish_stream("stdout", "Building " + targets.front().drv_path + "\n");
+        block_on(*m_aio, *m_cancel, m_store->buildPaths(
+            { nix::DerivedPath::Built{ .drvPath = nix::makeConstantStorePath(drvPath), .outputs = nix::OutputsSpec::All{} } }
         ));
 
-        auto localStore = m_store.try_cast_shared<nix::LocalFSStore>();
+        auto localStore = std::dynamic_pointer_cast<nix::LocalFSStore>(m_store);
         if (!localStore)
         {
             publish_stream(
@@ -210,14 +606,14 @@ namespace xeus_lix
         }
 
         publish_stream("stdout", "\nThis derivation produced the following outputs:\n");
-        for (auto& [outputName, outputPath] : m_aio->blockOn(m_store->queryDerivationOutputMap(*drvPath)))
+        for (auto& [outputName, outputPath] : block_on(*m_aio, *m_cancel, m_store->queryDerivationOutputMap(drvPath)))
         {
             if (localStore)
             {
                 std::string symlink = "result-" + outputName;
                 try
                 {
-                    m_aio->blockOn(localStore->addPermRoot(outputPath, nix::absPath(symlink)));
+                    block_on(*m_aio, *m_cancel, localStore->addPermRoot(outputPath, nix::absPath(symlink)));
                     publish_stream("stdout", "  ./" + symlink + " -> " + m_store->printStorePath(outputPath) + "\n");
                 }
                 catch (const std::exception& e)
@@ -232,54 +628,272 @@ namespace xeus_lix
         }
     }
 
-    // :env - Show variables in the current scope
-    void interpreter::repl_env(const std::string& /* arg */)
+    void interpreter::start_build_job(const nix::StorePath& drv_path, bool create_roots)
     {
-        std::stringstream ss;
+        size_t id = m_next_build_job++;
+        auto job = std::make_unique<build_job>();
+        job->id = id;
+        job->drv_path = m_store->printStorePath(drv_path);
+        // display ids are global to the notebook, so they must not repeat across kernel restarts
+        job->display_id = "xeus-lix-build-" + std::to_string(::getpid()) + "-" + std::to_string(id);
+        if (auto parent = request_context::current())
+        {
+            job->parent_header = *parent;
+        }
+        job->started = std::chrono::steady_clock::now();
+        auto& started = *m_build_jobs.emplace(id, std::move(job)).first->second;
 
-        std::function<void(const nix::StaticEnv*, int)> print_level =
-            [&](const nix::StaticEnv* senv, int level) {
+        show_build_job(started, false);
+        started.promise = run_build_job(id, drv_path, create_roots).eagerlyEvaluate(nullptr);
+    }
 
-            if (!senv) {
-                return;
+    kj::Promise<void> interpreter::run_build_job(size_t id, nix::StorePath drv_path, bool create_roots)
+    {
+        std::string message;
+        bool built = false;
+        try
+        {
+            (co_await m_store->buildPaths(
+                { nix::DerivedPath::Built{ .drvPath = nix::makeConstantStorePath(drv_path), .outputs = nix::OutputsSpec::All{} } }
+            )).value();
+
+            auto localStore = create_roots ? std::dynamic_pointer_cast<nix::LocalFSStore>(m_store) : nullptr;
+            for (auto& [outputName, outputPath] : (co_await m_store->queryDerivationOutputMap(drv_path)).value())
+            {
+                if (localStore)
+                {
+                    std::string symlink = "result-" + outputName;
+                    (co_await localStore->addPermRoot(outputPath, nix::absPath(symlink))).value();
+                    message += "  ./" + symlink + " -> " + m_store->printStorePath(outputPath) + "\n";
+                }
+                else
+                {
+                    message += "  " + outputName + " -> " + m_store->printStorePath(outputPath) + "\n";
+                }
             }
+            built = true;
+        }
+        catch (const std::exception& e)
+        {
+            message = e.what();
+        }
+        catch (const kj::Exception& e)
+        {
+            message = e.getDescription().cStr();
+        }
 
-            ss << "Env level " << level << "\n";
+        auto& job = *m_build_jobs.at(id);
+        job.status = built ? build_job::state::succeeded : build_job::state::failed;
+        job.finished = std::chrono::steady_clock::now();
+        job.message = std::move(message);
+        show_build_job(job, true);
+    }
 
-            if (senv->up) {
-                std::vector<std::string_view> var_names;
-                for (const auto& [symbol, displ] : senv->vars) {
-                    var_names.push_back(m_evaluator->symbols[symbol]);
-                }
-                std::sort(var_names.begin(), var_names.end());
+    void interpreter::show_build_job(const build_job& job, bool update)
+    {
+        request_context context(job.parent_header);
+        nl::json bundle;
+        std::string text = describe(job);
+        if (job.status == build_job::state::running)
+        {
+            text += m_logger->build_progress(job.drv_path);
+        }
+        bundle["text/plain"] = std::move(text);
+        nl::json transient;
+        transient["display_id"] = job.display_id;
+        if (update)
+        {
+            update_display_data(std::move(bundle), nl::json::object(), std::move(transient));
+        }
+        else
+        {
+            display_data(std::move(bundle), nl::json::object(), std::move(transient));
+        }
+    }
 
-                ss << "static: " << ANSI_MAGENTA;
-                for (const auto& name : var_names) {
-                    ss << name << " ";
-                }
-                ss << ANSI_NORMAL << "\n\n";
-
-                // recurse to the next level
-                print_level(senv->up, level + 1);
-            } else {
-                std::vector<std::string_view> var_names;
-                for (const auto& [symbol, displ] : senv->vars) {
-                     std::string_view name = m_evaluator->symbols[symbol];
-                     if (!name.starts_with("__")) { // exclude internal builtins
-                        var_names.push_back(name);
-                     }
+    void interpreter::refresh_build_jobs()
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now - m_build_jobs_shown < BUILD_JOB_REFRESH_INTERVAL)
+        {
+            return;
+        }
+        m_build_jobs_shown = now;
+        for (const auto& [id, job] : m_build_jobs)
+        {
+            if (job->status == build_job::state::running)
+            {
+                show_build_job(*job, true);
+            }
+        }
+    }
+
+    bool interpreter::pump_build_jobs()
+    {
+        auto running = [this] {
+            return std::any_of(m_build_jobs.begin(), m_build_jobs.end(), [](const auto& entry) {
+                return entry.second->status == build_job::state::running;
+            });
+        };
+        if (!running() || shutdown_requested())
+        {
+            return false;
+        }
+        try
+        {
+            // the builds advance in the event loop's callbacks while this waits
+            m_aio->blockOn(m_aio->kj.provider->getTimer().afterDelay(BUILD_JOB_PUMP_INTERVAL.count() * kj::MILLISECONDS));
+            refresh_build_jobs();
+            poll_output();
+        }
+        catch (const nix::Interrupted&)
+        {
+            // an interrupt with no cell to stop; a build's own failure is recorded by the build
+        }
+        catch (const kj::Exception& e)
+        {
+            // the event loop itself failed, so none of the builds can finish
+            for (auto& [id, job] : m_build_jobs)
+            {
+                if (job->status == build_job::state::running)
+                {
+                    job->promise.reset();
+                    job->status = build_job::state::failed;
+                    job->finished = std::chrono::steady_clock::now();
+                    job->message = e.getDescription().cStr();
+                    show_build_job(*job, true);
                 }
-                std::sort(var_names.begin(), var_names.end());
+            }
+        }
+        return running();
+    }
+
+    build_job& interpreter::find_build_job(const std::string& arg)
+    {
+        std::string number = nix::trim(arg);
+        if (number.starts_with("[") && number.ends_with("]"))
+        {
+            number = number.substr(1, number.size() - 2);
+        }
+        auto id = nix::string2Int<size_t>(number);
+        auto it = id ? m_build_jobs.find(*id) : m_build_jobs.end();
+        if (it == m_build_jobs.end())
+        {
+            throw nix::Error("no build job '%s', see :jobs", arg);
+        }
+        return *it->second;
+    }
 
-                ss << ANSI_MAGENTA;
-                for (const auto& name : var_names) {
-                    ss << name << " ";
+    // :jobs - List the background builds
+    void interpreter::repl_jobs(const std::string& /* arg */)
+    {
+        if (m_build_jobs.empty())
+        {
+            publish_stream("stdout", "No build jobs.\n");
+            return;
+        }
+        std::ostringstream md;
+        md << "| job | state | time | derivation |\n|---|---|---|---|\n";
+        for (const auto& [id, job] : m_build_jobs)
+        {
+            md << "| " << id << " | " << state_name(job->status) << " | " << elapsed(*job) << " | `" << job->drv_path << "` |\n";
+        }
+        nl::json bundle;
+        bundle["text/markdown"] = md.str();
+        display_data(std::move(bundle), nl::json::object(), nl::json::object());
+    }
+
+    // :wait [job] - Wait for a background build, or for all of them
+    void interpreter::repl_wait(const std::string& arg)
+    {
+        std::vector<build_job*> jobs;
+        if (arg.empty())
+        {
+            for (const auto& [id, job] : m_build_jobs)
+            {
+                if (job->status == build_job::state::running)
+                {
+                    jobs.push_back(job.get());
                 }
-                ss << ANSI_NORMAL << "\n";
             }
+        }
+        else
+        {
+            jobs.push_back(&find_build_job(arg));
+        }
+
+        auto running = [&] {
+            return std::any_of(jobs.begin(), jobs.end(), [](build_job* job) { return job->status == build_job::state::running; });
         };
+        auto& timer = m_aio->kj.provider->getTimer();
+        while (running())
+        {
+            m_cancel->check();
+            m_aio->blockOn(timer.afterDelay(CANCELLATION_POLL_INTERVAL.count() * kj::MILLISECONDS));
+            refresh_build_jobs();
+        }
 
-        print_level(m_staticEnv.get(), 0);
+        size_t failed = 0;
+        for (build_job* job : jobs)
+        {
+            publish_stream(job->status == build_job::state::succeeded ? "stdout" : "stderr", describe(*job));
+            failed += job->status != build_job::state::succeeded;
+        }
+        if (failed > 0)
+        {
+            throw nix::Error("%d of %d builds did not succeed", failed, jobs.size());
+        }
+    }
+
+    // :kill <job> - Cancel a background build
+    void interpreter::repl_kill(const std::string& arg)
+    {
+        build_job& job = find_build_job(arg);
+        if (job.status != build_job::state::running)
+        {
+            publish_stream("stderr", "Build job " + std::to_string(job.id) + " has already finished.\n");
+            return;
+        }
+        // dropping the promise cancels the build behind it
+        job.promise.reset();
+        job.status = build_job::state::killed;
+        job.finished = std::chrono::steady_clock::now();
+        show_build_job(job, true);
+        publish_stream("stdout", describe(job));
+    }
+
+    // :env - Show variables in the current scope
+    void interpreter::repl_env(const std::string& /* arg */)
+    {
+        std::stringstream ss;
+
+        auto print_names = [&](std::vector<std::string_view>& var_names) {
+            std::sort(var_names.begin(), var_names.end());
+            ss << ANSI_MAGENTA;
+            for (const auto& name : var_names) {
+                ss << name << " ";
+            }
+            ss << ANSI_NORMAL << "\n";
+        };
+
+        // the REPL's bindings are one level, however many env segments they span
+        std::vector<std::string_view> scope_names;
+        m_scope->for_each([&](nix::Symbol symbol, nix::Value*) {
+            scope_names.push_back(m_evaluator->symbols[symbol]);
+        });
+        ss << "Env level 0\n" << "static: ";
+        print_names(scope_names);
+        ss << "\n";
+
+        std::vector<std::string_view> builtin_names;
+        for (const auto& [symbol, displ] : m_evaluator->builtins.staticEnv->vars) {
+             std::string_view name = m_evaluator->symbols[symbol];
+             if (!name.starts_with("__")) { // exclude internal builtins
+                builtin_names.push_back(name);
+             }
+        }
+        ss << "Env level 1\n";
+        print_names(builtin_names);
 
         publish_stream("stdout", ss.str());
     }
@@ -293,25 +907,42 @@ namespace xeus_lix
             return;
         }
         auto flakeRef = nix::parseFlakeRef(std::string(arg), nix::absPath("."), true);
-        nix::Value v(nix::Value::null_t{});
-        nix::flake::callFlake(
+        auto lockedFlake = nix::flake::lockFlake(
             *m_evalState,
-            nix::flake::lockFlake(
-                *m_evalState,
-                flakeRef,
-                nix::flake::LockFlags{ .updateLockFile = false,
-                                       .useRegistries = !nix::evalSettings.pureEval.get(),
-                                       .allowUnlocked = !nix::evalSettings.pureEval.get() }
-            ),
-            v
+            flakeRef,
+            nix::flake::LockFlags{ .updateLockFile = false,
+                                   .useRegistries = !nix::evalSettings.pureEval.get(),
+                                   .allowUnlocked = !nix::evalSettings.pureEval.get() }
         );
-        m_evalState->forceAttrs(v, nix::noPos, "while loading flake outputs");
-        add_to_scope(*v.attrs);
+        nix::Value* v = m_evaluator->mem.allocValue();
+        nix::flake::callFlake(*m_evalState, lockedFlake, *v);
+        m_evalState->forceAttrs(*v, nix::noPos, "while loading flake outputs");
+        auto flake = std::make_unique<flake_output_cache>(*m_evaluator, lockedFlake, *v);
+        add_to_scope(*v->attrs);
+        m_flakes.push_back(std::move(flake));
+        record_session_command("load-flake", arg);
     }
 
     // :p <expr> - Evaluate and print expression recursively Strings are printed directly, without escaping.
+    // :p --more - Continue printing the last value whose output stopped
     void interpreter::repl_print(const std::string& arg)
     {
+        if (arg == "--more")
+        {
+            if (!m_print_continuation)
+            {
+                publish_stream("stderr", "Nothing more to print.\n");
+                return;
+            }
+            std::string out;
+            if (m_print_continuation->print(*m_evalState, out))
+            {
+                m_print_continuation.reset();
+            }
+            publish_stream("stdout", out + "\n");
+            return;
+        }
+
         nix::Value v(nix::Value::null_t{});
         eval_pure_expression(arg, v);
 
@@ -321,24 +952,15 @@ namespace xeus_lix
         }
         else
         {
-            std::stringstream ss;
-            nix::printValue(
-                *m_evalState,
-                ss,
-                v,
-                nix::PrintOptions{ .ansiColors = true,
-                                   .force = true,
-                                   .derivationPaths = true,
-                                   .maxDepth = std::numeric_limits<unsigned int>::max(),
-                                   .prettyIndent = 2 }
-            );
-            publish_stream("stdout", ss.str() + "\n");
+            publish_stream("stdout", print_value(v, DEEP_PRINT_LIMITS) + "\n");
         }
     }
 
-    // :log <expr | .drv path> - Show logs for a derivation
-    void interpreter::repl_log(const std::string& arg)
+    // :log [--tail N] [--grep <regex>] <expr | .drv path> - Show logs for a derivation
+    void interpreter::repl_log(const std::string& args)
     {
+        std::string arg = args;
+        auto filter = parse_log_filter(arg);
         if (arg.empty())
         {
             throw nix::Error(":log requires a derivation path or an expression");
@@ -370,30 +992,39 @@ namespace xeus_lix
 
         auto drvPathRaw = m_store->printStorePath(drvPath);
 
-        auto subs = m_aio->blockOn(nix::getDefaultSubstituters());
-        subs.push_front(m_store);
-
-        bool foundLog = false;
-        for (auto& sub : subs)
+        const build_log* log = m_build_logs->find(drvPathRaw);
+        if (!log)
         {
-            auto logSub = dynamic_cast<nix::LogStore*>(&*sub);
-            if (!logSub)
-            {
-                continue;
-            }
-
-            auto log = m_aio->blockOn(logSub->getBuildLog(drvPath));
-            if (log)
+            auto subs = block_on(*m_aio, *m_cancel, nix::getDefaultSubstituters());
+            std::vector<nix::ref<nix::Store>> stores{ nix::ref<nix::Store>(m_store) };
+            stores.insert(stores.end(), subs.begin(), subs.end());
+            auto lookup = block_on(*m_aio, *m_cancel, find_build_log(std::move(stores), drvPath));
+            if (!lookup.log)
             {
-                publish_stream("stdout", "Log for " + drvPathRaw + " from " + sub->getUri() + ":\n" + *log);
-                foundLog = true;
-                break;
+                for (const auto& error : lookup.errors)
+                {
+                    publish_stream("stderr", "Warning: " + error + "\n");
+                }
+                publish_stream("stderr", "No build log found for " + drvPathRaw + "\n");
+                return;
             }
+            log = &m_build_logs->insert(drvPathRaw, std::move(*lookup.log));
         }
 
-        if (!foundLog)
+        publish_stream("stdout", "Log for " + drvPathRaw + " from " + log->uri + ":\n");
+        auto text = filter_log(log->text, filter);
+        // in pieces that end at a line, so the frontend renders a long log as it arrives
+        for (size_t start = 0; start < text.size();)
         {
-            publish_stream("stderr", "No build log found for " + drvPathRaw + "\n");
+            size_t end = start + LOG_CHUNK_BYTES;
+            if (end < text.size())
+            {
+                size_t newline = text.rfind('\n', end);
+                end = newline != std::string::npos && newline >= start ? newline + 1 : end;
+            }
+            m_cancel->check();
+            publish_stream("stdout", text.substr(start, end - start));
+            start = end;
         }
     }
 
@@ -423,6 +1054,198 @@ namespace xeus_lix
         publish_stream("stdout", std::string("Error traces are now ") + (next ? "enabled.\n" : "disabled.\n"));
     }
 
+    // :stats - Show kernel statistics
+    void interpreter::repl_stats(const std::string& /* arg */)
+    {
+        size_t flake_hits = 0;
+        size_t flake_misses = 0;
+        for (const auto& flake : m_flakes)
+        {
+            flake_hits += flake->hits();
+            flake_misses += flake->misses();
+        }
+        std::stringstream ss;
+        ss << "parses: " << m_stats.parses << "\n"
+           << "parse cache hits: " << m_stats.parse_cache_hits << "\n"
+           << "parse cache misses: " << m_stats.parse_cache_misses << "\n"
+           << "attr cache hits: " << m_stats.attr_cache_hits << "\n"
+           << "attr cache misses: " << m_stats.attr_cache_misses << "\n"
+           << "attr index hits: " << m_stats.attr_index_hits << "\n"
+           << "doc cache hits: " << m_doc_cache->hits() << "\n"
+           << "doc cache misses: " << m_doc_cache->misses() << "\n"
+           << "stream writes: " << m_streams->writes() << "\n"
+           << "stream messages: " << m_streams->published() << "\n"
+           << "flake cache hits: " << flake_hits << "\n"
+           << "flake cache misses: " << flake_misses << "\n"
+           << "build logs cached: " << m_build_logs->size() << " (" << m_build_logs->bytes() / 1024 << " KiB)\n";
+        if (flake_hits + flake_misses > 0)
+        {
+            ss << "flake cache hit rate: " << flake_hits * 100 / (flake_hits + flake_misses) << "%\n";
+        }
+        if (m_session)
+        {
+            ss << "session replay: " << m_stats.replayed_commands << " of " << m_stats.replay_commands << " commands in "
+               << m_stats.replay_time.count() << " ms\n";
+        }
+        ss << "startup: lix ready " << m_stats.startup_time.count() << " ms after start\n";
+        if (!m_stats.prewarm_outcome.empty())
+        {
+            ss << "prewarm: " << m_stats.prewarm_outcome << " in " << m_stats.prewarm_time.count() << " ms\n";
+        }
+        if (int64_t first = m_first_completion_ms; first >= 0)
+        {
+            ss << "first completion: " << first << " ms after start\n";
+        }
+        ss << "watched files: " << m_file_watch->tracked() << " in " << m_file_watch->watches() << " directories\n"
+           << "scope bindings: " << m_scope->size() << " of " << m_scope->capacity() << " slots in "
+           << m_scope->segments() << " segments\n";
+        publish_stream("stdout", ss.str());
+    }
+
+    // :search <regex> [in <expr>] - Search derivations by attribute path, name or description
+    void interpreter::repl_search(const std::string& arg)
+    {
+        std::string pattern = nix::trim(arg);
+        std::string expr_str = "pkgs";
+        if (auto in_pos = pattern.find(" in "); in_pos != std::string::npos)
+        {
+            expr_str = nix::trim(pattern.substr(in_pos + 4));
+            pattern = nix::trim(pattern.substr(0, in_pos));
+        }
+        if (pattern.empty() || expr_str.empty())
+        {
+            throw nix::Error(":search requires a pattern, e.g. ':search ^python3 in pkgs'");
+        }
+        search_query query(pattern);
+
+        nix::Value v(nix::Value::null_t{});
+        eval_pure_expression(expr_str, v);
+        m_evalState->forceAttrs(v, nix::noPos, "while evaluating the attribute set to search");
+
+        // the index is reused as long as the expression still yields the same set
+        auto& index = m_search_indexes[expr_str];
+        if (!index || !index->indexes(v))
+        {
+            index = std::make_unique<package_search_index>(*m_evaluator, v);
+        }
+        if (!index->complete())
+        {
+            publish_stream("stdout", "Indexing " + expr_str + "...\n");
+            index->extend(*m_evalState, std::chrono::steady_clock::now() + SEARCH_TIME_BUDGET);
+        }
+
+        std::vector<const search_entry*> hits;
+        for (const auto& entry : index->entries())
+        {
+            if (query.matches(entry))
+            {
+                hits.push_back(&entry);
+            }
+        }
+        std::sort(hits.begin(), hits.end(), [](const search_entry* a, const search_entry* b) {
+            return a->attr_path < b->attr_path;
+        });
+
+        auto cell = [](std::string_view text) {
+            std::string escaped;
+            for (char c : text)
+            {
+                if (c == '|')
+                {
+                    escaped += "\\|";
+                }
+                else
+                {
+                    escaped += c == '\n' ? ' ' : c;
+                }
+            }
+            return escaped;
+        };
+
+        std::stringstream md;
+        if (hits.empty())
+        {
+            md << "No packages found.\n";
+        }
+        else
+        {
+            md << "| attribute | name | description |\n|---|---|---|\n";
+            for (size_t i = 0; i < std::min(hits.size(), MAX_SEARCH_RESULTS); ++i)
+            {
+                md << "| `" << hits[i]->attr_path << "` | " << cell(hits[i]->name) << " | "
+                   << cell(hits[i]->description) << " |\n";
+            }
+            if (hits.size() > MAX_SEARCH_RESULTS)
+            {
+                md << "\n" << hits.size() - MAX_SEARCH_RESULTS << " more results not shown.\n";
+            }
+        }
+        if (!index->complete())
+        {
+            md << "\n*The index of `" << expr_str << "` is incomplete (" << index->entries().size()
+               << " packages so far), run `:search` again to continue.*\n";
+        }
+        if (index->failures() > 0)
+        {
+            md << "\n*" << index->failures() << " attributes failed to evaluate and were skipped.*\n";
+        }
+
+        nl::json bundle;
+        bundle["text/markdown"] = md.str();
+        display_data(std::move(bundle), nl::json::object(), nl::json::object());
+    }
+
+    // :apropos <words> [in <expr>] - Search the documentation of builtins and library functions
+    void interpreter::repl_apropos(const std::string& arg)
+    {
+        std::string words = nix::trim(arg);
+        std::string expr_str;
+        if (auto in_pos = words.find(" in "); in_pos != std::string::npos)
+        {
+            expr_str = nix::trim(words.substr(in_pos + 4));
+            words = nix::trim(words.substr(0, in_pos));
+        }
+        else if (m_scope->lookup(m_evaluator->symbols.create("lib")))
+        {
+            expr_str = "lib";
+        }
+        if (words.empty())
+        {
+            throw nix::Error(":apropos requires search words, e.g. ':apropos concatenate strings'");
+        }
+
+        auto hits = builtins_doc_index().search(words, MAX_APROPOS_RESULTS);
+        if (!expr_str.empty())
+        {
+            nix::Value v(nix::Value::null_t{});
+            eval_pure_expression(expr_str, v);
+            m_evalState->forceAttrs(v, nix::noPos, "while evaluating the attribute set for :apropos");
+            auto lambda_hits = lambda_doc_index(expr_str, v).search(words, MAX_APROPOS_RESULTS);
+            hits.insert(hits.end(), lambda_hits.begin(), lambda_hits.end());
+            std::stable_sort(hits.begin(), hits.end(), &doc_search_index::better);
+            hits.resize(std::min(hits.size(), MAX_APROPOS_RESULTS));
+        }
+
+        if (hits.empty())
+        {
+            publish_stream("stdout", "Nothing appropriate.\n");
+            return;
+        }
+        std::stringstream md;
+        for (const auto& hit : hits)
+        {
+            md << "- `" << hit.name << "`";
+            if (!hit.summary.empty())
+            {
+                md << " — " << hit.summary;
+            }
+            md << "\n";
+        }
+        nl::json bundle;
+        bundle["text/markdown"] = md.str();
+        display_data(std::move(bundle), nl::json::object(), nl::json::object());
+    }
+
     // :help - Brings up this help menu
     void interpreter::repl_help(const std::string& /* arg */)
     {
@@ -432,20 +1255,33 @@ namespace xeus_lix
   <expr>                       Evaluate and print expression
   <x> = <expr>                 Bind expression to variable
   :a, :add <expr>              Add attributes from resulting set to scope
-  :b <expr>                    Build a derivation
-  :bl <expr>                   Build a derivation, creating GC roots
-                               in the working directory
+  :apropos <words> [in <expr>] Search the docs of builtins and of the
+                               functions in a set (default: in lib)
+  :b <expr> [&]                Build a derivation, or a list or set of
+                               them, in the background with a trailing &
+  :bl <expr> [&]               Build a derivation, or a list or set of
+                               them, creating GC roots in the working
+                               directory
   :env                         Show variables in the current scope
   :doc <expr>                  Show documentation for the provided value
+  :jobs                        List the background builds
+  :kill <job>                  Cancel a background build
   :l, :load <path>             Load Nix expression and add it to scope
   :lf, :load-flake <ref>       Load Nix flake and add it to scope
   :p, :print <expr>            Evaluate and print expression recursively
                                Strings are printed directly, without escaping.
-  :r, :reload                  Reload all files
+  :p --more                    Continue printing where the output stopped
+  :r, :reload                  Reload the files that changed
   :t <expr>                    Describe result of evaluation
-  :log <expr | .drv path>      Show logs for a derivation
+  :log [--tail N] [--grep <re>] <expr | .drv path>
+                               Show logs for a derivation, or only its
+                               last N lines or those matching <re>
+  :search <regex> [in <expr>]  Search packages by attribute path, name
+                               or description (default: in pkgs)
+  :stats                       Show kernel statistics
   :te, :trace-enable [bool]    Enable, disable or toggle showing traces for
                                errors
+  :wait [job]                  Wait for a background build, or for all
   :?, :help                    Brings up this help menu
 ```
 )md";
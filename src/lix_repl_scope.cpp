@@ -0,0 +1,70 @@
+#include "lix_repl_scope.hpp"
+
+#include <algorithm>
+
+namespace xeus_lix
+{
+    repl_scope::repl_scope(nix::Evaluator& evaluator)
+        : m_evaluator(evaluator)
+    {
+        add_segment(REPL_SCOPE_FIRST_SEGMENT);
+    }
+
+    void repl_scope::add_segment(uint32_t size)
+    {
+        const nix::StaticEnv* static_up = m_segments.empty() ? m_evaluator.builtins.staticEnv.get() : m_segments.back().static_env.get();
+        nix::Env* up = m_segments.empty() ? &m_evaluator.builtins.env : m_segments.back().env;
+
+        segment seg{
+            .env = &m_evaluator.mem.allocEnv(size),
+            .static_env = std::make_shared<nix::StaticEnv>(nullptr, static_up),
+            .used = 0,
+            .size = size,
+        };
+        seg.env->up = up;
+        m_segments.push_back(std::move(seg));
+    }
+
+    void repl_scope::bind(nix::Symbol name, nix::Value* value)
+    {
+        if (m_segments.back().used == m_segments.back().size)
+        {
+            add_segment(std::min(m_segments.back().size * 2, REPL_SCOPE_MAX_SEGMENT));
+        }
+        segment& top = m_segments.back();
+        top.static_env->vars.insert_or_assign(name, top.used);
+        top.env->values[top.used++] = value;
+    }
+
+    nix::Value* repl_scope::lookup(nix::Symbol name) const
+    {
+        for (auto seg = m_segments.rbegin(); seg != m_segments.rend(); ++seg)
+        {
+            if (auto var = seg->static_env->find(name); var != seg->static_env->vars.end())
+            {
+                return seg->env->values[var->second];
+            }
+        }
+        return nullptr;
+    }
+
+    size_t repl_scope::size() const
+    {
+        size_t n = 0;
+        for (const auto& seg : m_segments)
+        {
+            n += seg.used;
+        }
+        return n;
+    }
+
+    size_t repl_scope::capacity() const
+    {
+        size_t n = 0;
+        for (const auto& seg : m_segments)
+        {
+            n += seg.size;
+        }
+        return n;
+    }
+}
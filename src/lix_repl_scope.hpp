@@ -0,0 +1,76 @@
+#ifndef XEUS_LIX_REPL_SCOPE_HPP
+#define XEUS_LIX_REPL_SCOPE_HPP
+
+#include "lix/libexpr/eval.hh"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace xeus_lix
+{
+    // the variables bound in the REPL, above the builtins
+    // they live in a chain of Envs, one per segment, each with the StaticEnv the parser
+    // resolves names against. a full segment is never reallocated, since closures and
+    // thunks hold on to it; instead a new, twice as large segment is chained on top, so the
+    // scope grows with the bindings made and the garbage collector only scans those.
+    // rebinding a name takes a new slot that shadows the old one: code that captured the
+    // old binding keeps seeing the value it was defined against, as in `nix repl`
+    class repl_scope
+    {
+    public:
+        explicit repl_scope(nix::Evaluator& evaluator);
+
+        void bind(nix::Symbol name, nix::Value* value);
+        // the value bound to `name` in the REPL, nullptr if it is not bound here
+        nix::Value* lookup(nix::Symbol name) const;
+
+        // what input is parsed against and evaluated in; both change when a segment is
+        // added, so an expression must be evaluated in the env of the static env it was
+        // parsed against
+        const std::shared_ptr<nix::StaticEnv>& static_env() const { return m_segments.back().static_env; }
+        nix::Env& env() const { return *m_segments.back().env; }
+
+        // calls `visit(name, value)` for every visible binding, most recent segment first
+        template<typename Visitor>
+        void for_each(Visitor&& visit) const
+        {
+            for (auto seg = m_segments.rbegin(); seg != m_segments.rend(); ++seg)
+            {
+                for (const auto& [name, displ] : seg->static_env->vars)
+                {
+                    nix::Value* value = seg->env->values[displ];
+                    if (lookup(name) == value)
+                    {
+                        visit(name, value);
+                    }
+                }
+            }
+        }
+
+        // slots taken and allocated
+        size_t size() const;
+        size_t capacity() const;
+        size_t segments() const { return m_segments.size(); }
+
+    private:
+        struct segment
+        {
+            nix::Env* env;
+            std::shared_ptr<nix::StaticEnv> static_env;
+            uint32_t used;
+            uint32_t size;
+        };
+
+        void add_segment(uint32_t size);
+
+        nix::Evaluator& m_evaluator;
+        std::vector<segment> m_segments;
+    };
+
+    // the first segment is small, later ones double up to the largest size
+    inline constexpr uint32_t REPL_SCOPE_FIRST_SEGMENT = 256;
+    inline constexpr uint32_t REPL_SCOPE_MAX_SEGMENT = 1 << 16;
+}
+
+#endif
@@ -0,0 +1,121 @@
+#include "lix_search_index.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+#include "lix/libexpr/get-drvs.hh"
+#include "lix/libutil/signals.hh"
+
+namespace xeus_lix
+{
+    namespace
+    {
+        std::string to_lower(std::string_view s)
+        {
+            std::string lowered(s);
+            std::transform(lowered.begin(), lowered.end(), lowered.begin(), [](unsigned char c) {
+                return static_cast<char>(std::tolower(c));
+            });
+            return lowered;
+        }
+    }
+
+    search_query::search_query(const std::string& pattern)
+    {
+        if (pattern.find_first_of("\\^$.|?*+()[]{}") == std::string::npos)
+        {
+            m_literal = to_lower(pattern);
+        }
+        else
+        {
+            m_regex.emplace(pattern, std::regex::ECMAScript | std::regex::icase | std::regex::optimize);
+        }
+    }
+
+    bool search_query::matches(const search_entry& entry) const
+    {
+        if (!m_regex)
+        {
+            return entry.haystack.find(m_literal) != std::string::npos;
+        }
+        return std::regex_search(entry.attr_path, *m_regex) || std::regex_search(entry.name, *m_regex)
+            || std::regex_search(entry.description, *m_regex);
+    }
+
+    package_search_index::package_search_index(nix::Evaluator& evaluator, nix::Value& root)
+        : m_evaluator(evaluator)
+        , m_root(nix::allocRootValue(evaluator.mem.allocValue()))
+    {
+        // `root` may well live on the caller's stack
+        **m_root = root;
+        m_stack.push_back({ .set = m_root, .prefix = "", .next = 0 });
+    }
+
+    bool package_search_index::indexes(const nix::Value& v) const
+    {
+        return v.type() == nix::nAttrs && (*m_root)->attrs == v.attrs;
+    }
+
+    bool package_search_index::extend(nix::EvalState& state, std::chrono::steady_clock::time_point deadline)
+    {
+        const nix::Symbol s_recurse = m_evaluator.symbols.create("recurseForDerivations");
+
+        while (!m_stack.empty())
+        {
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                return false;
+            }
+            nix::checkInterrupt();
+
+            nix::Bindings& attrs = *(*m_stack.back().set)->attrs;
+            size_t index = m_stack.back().next;
+            if (index == attrs.size())
+            {
+                m_stack.pop_back();
+                continue;
+            }
+            const nix::Attr& attr = *(attrs.begin() + index);
+            const std::string& prefix = m_stack.back().prefix;
+            std::string_view name = m_evaluator.symbols[attr.name];
+            std::string path = prefix.empty() ? std::string(name) : prefix + "." + std::string(name);
+
+            // only advance once the attribute is dealt with, so an interrupt retries it
+            std::optional<frame> nested;
+            try
+            {
+                nix::Value& v = *attr.value;
+                state.forceValue(v, attr.pos);
+                if (v.type() == nix::nAttrs)
+                {
+                    if (auto drv = nix::getDerivation(state, v, true))
+                    {
+                        search_entry entry{ .attr_path = path,
+                                            .name = drv->queryName(state),
+                                            .description = drv->queryMetaString(state, "description"),
+                                            .haystack = {} };
+                        entry.haystack = to_lower(entry.attr_path + "\n" + entry.name + "\n" + entry.description);
+                        m_entries.push_back(std::move(entry));
+                    }
+                    else if (auto recurse = v.attrs->get(s_recurse);
+                             recurse && state.forceBool(*recurse->value, recurse->pos, "while evaluating recurseForDerivations"))
+                    {
+                        nested = frame{ .set = nix::allocRootValue(&v), .prefix = std::move(path), .next = 0 };
+                    }
+                }
+            }
+            catch (const nix::Error&)
+            {
+                // broken, unfree or unsupported packages are skipped, as `nix search` does
+                ++m_failures;
+            }
+
+            m_stack.back().next = index + 1;
+            if (nested)
+            {
+                m_stack.push_back(std::move(*nested));
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef XEUS_LIX_SEARCH_INDEX_HPP
+#define XEUS_LIX_SEARCH_INDEX_HPP
+
+#include "lix/libexpr/eval.hh"
+
+#include <chrono>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace xeus_lix
+{
+    // a derivation found below the searched attribute set
+    struct search_entry
+    {
+        std::string attr_path;
+        std::string name;
+        std::string description;
+        // attr_path, name and description lowercased and joined by newlines, for literal queries
+        std::string haystack;
+    };
+
+    // what a `:search` query is matched against. a pattern without regex metacharacters
+    // is looked up as a case-insensitive substring, which is much cheaper than std::regex
+    class search_query
+    {
+    public:
+        explicit search_query(const std::string& pattern);
+        bool matches(const search_entry& entry) const;
+
+    private:
+        std::string m_literal;
+        std::optional<std::regex> m_regex;
+    };
+
+    // the derivations of an attribute set, collected the way `nix search` walks it: the
+    // top level is always entered, nested sets only if `recurseForDerivations = true`.
+    // the walk is resumable, so it can be spread over several queries if it runs out
+    // of time or gets interrupted, and every entry found so far is kept
+    class package_search_index
+    {
+    public:
+        package_search_index(nix::Evaluator& evaluator, nix::Value& root);
+
+        // whether `v` is the very set this index was built from
+        bool indexes(const nix::Value& v) const;
+
+        // continues the walk until it is done or `deadline` passes, returns true once done
+        // attributes that fail to evaluate are counted and skipped, interrupts propagate
+        bool extend(nix::EvalState& state, std::chrono::steady_clock::time_point deadline);
+
+        bool complete() const { return m_stack.empty(); }
+        size_t failures() const { return m_failures; }
+        const std::vector<search_entry>& entries() const { return m_entries; }
+
+    private:
+        struct frame
+        {
+            nix::RootValue set;
+            std::string prefix;
+            size_t next = 0;
+        };
+
+        nix::Evaluator& m_evaluator;
+        nix::RootValue m_root;
+        std::vector<frame> m_stack;
+        std::vector<search_entry> m_entries;
+        size_t m_failures = 0;
+    };
+}
+
+#endif
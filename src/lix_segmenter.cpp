@@ -0,0 +1,200 @@
+#include "lix_segmenter.hpp"
+#include "lix_lexer.hpp"
+
+#include <algorithm>
+
+namespace xeus_lix
+{
+    namespace
+    {
+        size_t line_start_of(std::string_view code, size_t offset)
+        {
+            size_t nl = code.rfind('\n', offset == 0 ? 0 : offset - 1);
+            return (nl == std::string_view::npos || offset == 0) ? 0 : nl + 1;
+        }
+
+        size_t line_end_of(std::string_view code, size_t offset)
+        {
+            size_t nl = code.find('\n', offset);
+            return nl == std::string_view::npos ? code.size() : nl + 1;
+        }
+
+        // a `!` line ending in a backslash continues on the next line
+        size_t shell_block_end(std::string_view code, size_t offset)
+        {
+            size_t end = offset;
+            while (end < code.size())
+            {
+                size_t next = line_end_of(code, end);
+                std::string_view line = code.substr(end, next - end);
+                size_t last = line.find_last_not_of(" \t\r\n");
+                end = next;
+                if (last == std::string_view::npos || line[last] != '\\')
+                {
+                    break;
+                }
+            }
+            return end;
+        }
+
+        // tokens that can only continue the expression on the previous line
+        bool continues_expression(const token& tok)
+        {
+            static constexpr std::string_view continuation_tokens[] = {
+                "++", "//", "+", "*", "/", "==", "!=", "<", ">", "<=", ">=", "&&", "||",
+                "->", "|>", "<|", ".", "?", "=", "then", "else", "in", "or",
+            };
+            return std::any_of(std::begin(continuation_tokens), std::end(continuation_tokens), [&](std::string_view t) {
+                return tok.is(t);
+            });
+        }
+
+        // drops `opener` and everything opened after it, if it is pending at all
+        void close_until(std::vector<char>& open, char opener)
+        {
+            auto it = std::find(open.rbegin(), open.rend(), opener);
+            if (it != open.rend())
+            {
+                open.erase(std::prev(it.base()), open.end());
+            }
+        }
+
+        // updates the nesting state with one token; `open` holds pending brackets as well as
+        // 'L' (let, closed by `in`), 'I' (if, closed by `else`) and 'W' (with/assert, closed by `;`)
+        void track(const token& tok, std::vector<char>& open, bool& expects_operand)
+        {
+            expects_operand = false;
+            if (tok.kind == token_kind::punct)
+            {
+                if (tok.is("{") || tok.is("[") || tok.is("("))
+                {
+                    open.push_back(tok.text[0]);
+                }
+                else if (tok.is("}"))
+                {
+                    close_until(open, '{');
+                }
+                else if (tok.is("]"))
+                {
+                    close_until(open, '[');
+                }
+                else if (tok.is(")"))
+                {
+                    close_until(open, '(');
+                }
+                else if (tok.is(";"))
+                {
+                    if (!open.empty() && open.back() == 'W')
+                    {
+                        open.pop_back();
+                        expects_operand = true;
+                    }
+                }
+                else
+                {
+                    // any other operator or separator needs something after it
+                    expects_operand = true;
+                }
+            }
+            else if (tok.kind == token_kind::identifier)
+            {
+                if (tok.is("let"))
+                {
+                    open.push_back('L');
+                }
+                else if (tok.is("if"))
+                {
+                    open.push_back('I');
+                }
+                else if (tok.is("with") || tok.is("assert"))
+                {
+                    open.push_back('W');
+                }
+                else if (tok.is("in"))
+                {
+                    close_until(open, 'L');
+                    expects_operand = true;
+                }
+                else if (tok.is("else"))
+                {
+                    close_until(open, 'I');
+                    expects_operand = true;
+                }
+                else if (tok.is("then") || tok.is("rec") || tok.is("inherit") || tok.is("or"))
+                {
+                    expects_operand = true;
+                }
+            }
+        }
+    }
+
+    std::vector<cell_chunk> split_cell(const std::string_view code)
+    {
+        std::vector<cell_chunk> chunks;
+        lexer lex(code);
+
+        std::vector<char> open;
+        bool expects_operand = false;
+        bool has_tokens = false;
+        size_t chunk_start = 0;
+
+        // emits the expression collected so far; chunks holding only comments are dropped
+        auto flush = [&](size_t end) {
+            if (has_tokens)
+            {
+                chunks.push_back({ cell_chunk::kind::expression, std::string(code.substr(chunk_start, end - chunk_start)) });
+            }
+            chunk_start = end;
+            has_tokens = false;
+            expects_operand = false;
+            open.clear();
+        };
+
+        while (true)
+        {
+            token tok = lex.next();
+            if (tok.kind == token_kind::eof)
+            {
+                flush(code.size());
+                break;
+            }
+
+            const size_t line_start = line_start_of(code, tok.offset);
+            const bool first_on_line = code.find_first_not_of(" \t\r", line_start) == tok.offset;
+            const bool at_boundary = !has_tokens || (open.empty() && !expects_operand);
+
+            if (first_on_line && at_boundary)
+            {
+                const char c = code[tok.offset];
+                if (c == ':' || c == '!')
+                {
+                    flush(line_start);
+                    const bool is_shell = c == '!';
+                    const size_t end = is_shell ? shell_block_end(code, line_start) : line_end_of(code, line_start);
+                    chunks.push_back({ is_shell ? cell_chunk::kind::shell_command : cell_chunk::kind::repl_command,
+                                       std::string(code.substr(line_start, end - line_start)) });
+                    chunk_start = end;
+                    lex.seek(end);
+                    continue;
+                }
+                if (has_tokens && !continues_expression(tok))
+                {
+                    flush(line_start);
+                }
+            }
+
+            has_tokens = true;
+            track(tok, open, expects_operand);
+
+            // an unterminated string or comment swallows the rest of the cell; the
+            // parser will report it when the chunk runs
+            if (tok.unterminated)
+            {
+                flush(code.size());
+                break;
+            }
+        }
+
+        return chunks;
+    }
+}
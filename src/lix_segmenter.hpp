@@ -0,0 +1,32 @@
+#ifndef XEUS_LIX_SEGMENTER_HPP
+#define XEUS_LIX_SEGMENTER_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace xeus_lix
+{
+    // a piece of a code cell that is executed on its own
+    struct cell_chunk
+    {
+        enum class kind
+        {
+            expression,
+            repl_command,
+            shell_command
+        };
+
+        kind type;
+        std::string text;
+    };
+
+    // splits a cell into expressions, `:` commands and `!` shell blocks in a single
+    // lexical pass. chunk boundaries are placed at line breaks where every bracket,
+    // let/in, if/else and with/assert is closed and no operator is waiting for its
+    // right-hand side. the lix parser is not involved, so each chunk can be parsed
+    // exactly once when it is about to run
+    std::vector<cell_chunk> split_cell(std::string_view code);
+}
+
+#endif
@@ -0,0 +1,215 @@
+#include "lix_server.hpp"
+
+#include "lix_cancellation.hpp"
+
+#include "xeus-zmq/xserver_zmq_split.hpp"
+#include "xeus/xmessage.hpp"
+
+#include <string>
+#include <utility>
+
+namespace xeus_lix
+{
+    namespace
+    {
+        std::atomic<control_server*> s_server = nullptr;
+        thread_local const request_context* t_request_context = nullptr;
+        thread_local bool t_abort_requested = false;
+    }
+
+    control_server::control_server(std::unique_ptr<xeus::xserver> server)
+        : p_server(std::move(server))
+    {
+        // the kernel registers its listeners with this server, the wrapped one reports to us
+        p_server->register_shell_listener([this](xeus::xmessage msg) {
+            m_shell_thread = std::this_thread::get_id();
+            if (auto abort = take_pending_abort())
+            {
+                // sent before the failed cell's reply could stop the frontend from sending more
+                abort->abort_request(std::move(msg));
+                p_server->abort_queue(abort->abort_request, abort->polling_interval);
+                return;
+            }
+            notify_shell_listener(std::move(msg));
+        });
+        p_server->register_stdin_listener([this](xeus::xmessage msg) { notify_stdin_listener(std::move(msg)); });
+        p_server->register_internal_listener([this](nlohmann::json msg) { return notify_internal_listener(std::move(msg)); });
+        p_server->register_control_listener([this](xeus::xmessage msg) {
+            // called on the control thread while the shell thread may be deep in an evaluation
+            const std::string msg_type = msg.header().value("msg_type", "");
+            if (msg_type == "interrupt_request")
+            {
+                request_interrupt();
+            }
+            else if (msg_type == "shutdown_request")
+            {
+                request_shutdown();
+            }
+            notify_control_listener(std::move(msg));
+        });
+        s_server = this;
+    }
+
+    control_server::~control_server()
+    {
+        s_server = nullptr;
+    }
+
+    void control_server::publish_for(const nlohmann::json& parent_header, const std::string& msg_type, nlohmann::json content)
+    {
+        std::lock_guard lock(m_send_mutex);
+        p_server->publish(
+            xeus::xpub_message(
+                m_topic_prefix + msg_type,
+                xeus::make_header(msg_type, m_user_name, m_session_id),
+                parent_header,
+                nlohmann::json::object(),
+                std::move(content),
+                xeus::buffer_sequence()
+            ),
+            xeus::channel::SHELL
+        );
+    }
+
+    void control_server::send_shell_impl(xeus::xmessage message)
+    {
+        std::lock_guard lock(m_send_mutex);
+        if (auto parent = request_context::current())
+        {
+            // an execute reply sent from the evaluation thread
+            message = xeus::xmessage(
+                message.identities(),
+                message.header(),
+                *parent,
+                message.metadata(),
+                message.content(),
+                message.buffers()
+            );
+        }
+        p_server->send_shell(std::move(message));
+    }
+
+    void control_server::send_control_impl(xeus::xmessage message)
+    {
+        std::lock_guard lock(m_send_mutex);
+        p_server->send_control(std::move(message));
+    }
+
+    void control_server::send_stdin_impl(xeus::xmessage message)
+    {
+        std::lock_guard lock(m_send_mutex);
+        p_server->send_stdin(std::move(message));
+    }
+
+    void control_server::publish_impl(xeus::xpub_message message, xeus::channel c)
+    {
+        std::lock_guard lock(m_send_mutex);
+        if (auto parent = request_context::current())
+        {
+            // e.g. the status xeus publishes along with an execute reply
+            message = xeus::xpub_message(
+                message.topic(),
+                message.header(),
+                *parent,
+                message.metadata(),
+                message.content(),
+                message.buffers()
+            );
+        }
+        p_server->publish(std::move(message), c);
+    }
+
+    void control_server::start_impl(xeus::xpub_message message)
+    {
+        {
+            std::lock_guard lock(m_send_mutex);
+            const std::string& topic = message.topic();
+            m_topic_prefix = topic.substr(0, topic.rfind('.') + 1);
+            m_user_name = message.header().value("username", "");
+            m_session_id = message.header().value("session", "");
+        }
+        p_server->start(std::move(message));
+    }
+
+    void control_server::abort_queue_impl(const listener& l, long polling_interval)
+    {
+        if (std::this_thread::get_id() == m_shell_thread.load())
+        {
+            p_server->abort_queue(l, polling_interval);
+            return;
+        }
+        // an error reply sent from the evaluation thread: the shell thread polls the shell
+        // socket, so it aborts the requests still arriving, and the kernel the ones it queued
+        {
+            std::lock_guard lock(m_abort_mutex);
+            m_pending_abort = pending_abort{
+                .abort_request = l,
+                .polling_interval = polling_interval,
+                .until = std::chrono::steady_clock::now() + std::chrono::milliseconds(polling_interval),
+            };
+        }
+        t_abort_requested = true;
+    }
+
+    std::optional<control_server::pending_abort> control_server::take_pending_abort()
+    {
+        std::lock_guard lock(m_abort_mutex);
+        std::optional<pending_abort> abort = std::move(m_pending_abort);
+        m_pending_abort.reset();
+        if (abort && std::chrono::steady_clock::now() >= abort->until)
+        {
+            abort.reset();
+        }
+        return abort;
+    }
+
+    void control_server::stop_impl()
+    {
+        p_server->stop();
+    }
+
+    void control_server::update_config_impl(xeus::xconfiguration& config) const
+    {
+        p_server->update_config(config);
+    }
+
+    std::unique_ptr<xeus::xserver> make_control_server(
+        xeus::xcontext& context,
+        const xeus::xconfiguration& config,
+        nlohmann::json::error_handler_t eh
+    )
+    {
+        // shell on the main thread, control on a thread of its own
+        return std::make_unique<control_server>(xeus::make_xserver_shell_main(context, config, eh));
+    }
+
+    request_context::request_context(nlohmann::json parent_header)
+        : m_parent_header(std::move(parent_header))
+        , m_outer(t_request_context)
+    {
+        t_request_context = this;
+    }
+
+    request_context::~request_context()
+    {
+        t_request_context = m_outer;
+    }
+
+    const nlohmann::json* request_context::current()
+    {
+        return t_request_context ? &t_request_context->m_parent_header : nullptr;
+    }
+
+    void publish_in_request(const nlohmann::json& parent_header, const std::string& msg_type, nlohmann::json content)
+    {
+        if (auto server = s_server.load())
+        {
+            server->publish_for(parent_header, msg_type, std::move(content));
+        }
+    }
+
+    bool take_abort_request()
+    {
+        return std::exchange(t_abort_requested, false);
+    }
+}
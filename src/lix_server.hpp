@@ -0,0 +1,107 @@
+#ifndef XEUS_LIX_SERVER_HPP
+#define XEUS_LIX_SERVER_HPP
+
+#include "nlohmann/json.hpp"
+#include "xeus/xeus_context.hpp"
+#include "xeus/xkernel_configuration.hpp"
+#include "xeus/xserver.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace xeus_lix
+{
+    // the kernel's server: shell requests are handled on the main thread, which owns the
+    // lix evaluator, while control messages and heartbeats are answered on their own
+    // threads, so they are not queued behind a long evaluation or build.
+    // an `interrupt_request` arriving on the control channel interrupts the running
+    // request the same way SIGINT does, before xeus replies to it; a `shutdown_request`
+    // also drops the requests queued behind it, see request_shutdown.
+    // cells reply and publish from the evaluation thread, so everything sent through the
+    // server is serialized here, and attributed to the calling thread's request_context
+    class control_server : public xeus::xserver
+    {
+    public:
+        explicit control_server(std::unique_ptr<xeus::xserver> server);
+        ~control_server() override;
+
+        // an iopub message with the given parent header, built here rather than by the
+        // kernel core, whose parent header is the shell thread's
+        void publish_for(const nlohmann::json& parent_header, const std::string& msg_type, nlohmann::json content);
+
+    private:
+        void send_shell_impl(xeus::xmessage message) override;
+        void send_control_impl(xeus::xmessage message) override;
+        void send_stdin_impl(xeus::xmessage message) override;
+        void publish_impl(xeus::xpub_message message, xeus::channel c) override;
+        void start_impl(xeus::xpub_message message) override;
+        void abort_queue_impl(const listener& l, long polling_interval) override;
+        void stop_impl() override;
+        void update_config_impl(xeus::xconfiguration& config) const override;
+
+        // an abort of the shell queue asked for off the shell thread, which carries it out
+        // on the requests that arrive before `until`
+        struct pending_abort
+        {
+            listener abort_request;
+            long polling_interval;
+            std::chrono::steady_clock::time_point until;
+        };
+        std::optional<pending_abort> take_pending_abort();
+
+        std::unique_ptr<xeus::xserver> p_server;
+        std::mutex m_send_mutex;
+        std::atomic<std::thread::id> m_shell_thread;
+        std::mutex m_abort_mutex;
+        std::optional<pending_abort> m_pending_abort;
+        // what messages built by publish_for need, taken from the kernel's starting message
+        std::string m_topic_prefix;
+        std::string m_user_name;
+        std::string m_session_id;
+    };
+
+    // the server builder handed to xeus::xkernel
+    std::unique_ptr<xeus::xserver> make_control_server(
+        xeus::xcontext& context,
+        const xeus::xconfiguration& config,
+        nlohmann::json::error_handler_t eh
+    );
+
+    // attributes what the calling thread sends to the request with `parent_header` while
+    // it lives. xeus keeps one parent header, that of the request the shell thread
+    // dispatched last, so without it a cell's output on the evaluation thread would go to
+    // whatever completion or inspection was answered meanwhile. contexts nest
+    class request_context
+    {
+    public:
+        explicit request_context(nlohmann::json parent_header);
+        ~request_context();
+
+        request_context(const request_context&) = delete;
+        request_context& operator=(const request_context&) = delete;
+
+        // the parent header of the calling thread's innermost context, or null
+        static const nlohmann::json* current();
+
+    private:
+        nlohmann::json m_parent_header;
+        const request_context* m_outer;
+    };
+
+    // publishes on iopub under `parent_header` through the running server, see
+    // control_server::publish_for; nothing happens once the server is gone
+    void publish_in_request(const nlohmann::json& parent_header, const std::string& msg_type, nlohmann::json content);
+
+    // whether xeus asked the calling thread to abort the queued requests since the last
+    // call, as it does after an error reply to a request with `stop_on_error`. off the
+    // shell thread the server leaves the shell socket alone, so the kernel has to abort
+    // what it queued itself
+    bool take_abort_request();
+}
+
+#endif
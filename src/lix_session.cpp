@@ -0,0 +1,89 @@
+#include "lix_session.hpp"
+#include "lix_attr_index.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+
+namespace xeus_lix
+{
+    namespace
+    {
+        constexpr std::string_view SESSION_MAGIC = "xeus-lix session 1";
+    }
+
+    session_manifest::session_manifest(std::string key)
+        : m_key(std::move(key))
+        , m_file(cache_directory() / "sessions" / cache_file_name(m_key, ".session"))
+    {
+        std::ifstream in(m_file);
+        std::string line;
+        if (!std::getline(in, line) || line != SESSION_MAGIC || !std::getline(in, line) || line != m_key)
+        {
+            return;
+        }
+        while (std::getline(in, line))
+        {
+            size_t space = line.find(' ');
+            if (space == std::string::npos || space + 1 == line.size())
+            {
+                continue;
+            }
+            m_commands.push_back({ .name = line.substr(0, space), .arg = line.substr(space + 1) });
+        }
+    }
+
+    void session_manifest::append(std::string name, std::string arg)
+    {
+        if (arg.empty() || arg.find('\n') != std::string::npos)
+        {
+            return;
+        }
+        std::erase_if(m_commands, [&](const command& recorded) {
+            return recorded.name == name && recorded.arg == arg;
+        });
+        m_commands.push_back({ .name = std::move(name), .arg = std::move(arg) });
+        save();
+    }
+
+    void session_manifest::save() const
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(m_file.parent_path(), ec);
+        if (ec)
+        {
+            return;
+        }
+        // written aside and renamed over the old one, so a crash never leaves half a file
+        auto temporary = m_file;
+        temporary += "." + std::to_string(::getpid()) + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::trunc);
+            if (!out)
+            {
+                return;
+            }
+            out << SESSION_MAGIC << '\n' << m_key << '\n';
+            for (const auto& command : m_commands)
+            {
+                out << command.name << ' ' << command.arg << '\n';
+            }
+            if (!out.flush())
+            {
+                std::filesystem::remove(temporary, ec);
+                return;
+            }
+        }
+        std::filesystem::rename(temporary, m_file, ec);
+    }
+
+    std::string session_key()
+    {
+        if (const char* notebook = std::getenv("JPY_SESSION_NAME"); notebook && *notebook)
+        {
+            return notebook;
+        }
+        std::error_code ec;
+        return std::filesystem::current_path(ec).string();
+    }
+}
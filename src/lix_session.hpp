@@ -0,0 +1,61 @@
+#ifndef XEUS_LIX_SESSION_HPP
+#define XEUS_LIX_SESSION_HPP
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace xeus_lix
+{
+    // the commands that set a REPL session up, so that a restarted kernel can run them again
+    // one text file per notebook under the cache directory, rewritten whenever it changes:
+    //
+    //     xeus-lix session 1
+    //     <key>
+    //     load /nix/store/...-source/default.nix
+    //     load-flake github:owner/repo
+    //     add import ./overlay.nix {}
+    //
+    // it is only a cache: a file that cannot be read starts an empty session, and one
+    // that cannot be written is not an error
+    class session_manifest
+    {
+    public:
+        struct command
+        {
+            // `load`, `load-flake` or `add`
+            std::string name;
+            std::string arg;
+        };
+
+        explicit session_manifest(std::string key);
+
+        const std::vector<command>& commands() const { return m_commands; }
+        // arguments spanning several lines are not recorded; a command that is already
+        // recorded moves to the end, since it runs again after the ones before it
+        void append(std::string name, std::string arg);
+
+        // drops the commands for which `pred` holds
+        template<typename Pred>
+        void erase_if(Pred pred)
+        {
+            if (std::erase_if(m_commands, pred) > 0)
+            {
+                save();
+            }
+        }
+
+    private:
+        void save() const;
+
+        std::string m_key;
+        std::filesystem::path m_file;
+        std::vector<command> m_commands;
+    };
+
+    // what names the manifest of this kernel's notebook: the notebook path jupyter
+    // passes in JPY_SESSION_NAME, or the working directory
+    std::string session_key();
+}
+
+#endif
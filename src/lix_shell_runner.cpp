@@ -0,0 +1,295 @@
+#include "lix_shell_runner.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <optional>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "lix/libutil/error.hh"
+
+extern char** environ;
+
+namespace xeus_lix
+{
+    namespace
+    {
+        using clock = std::chrono::steady_clock;
+
+        struct fd_guard
+        {
+            int fd = -1;
+            ~fd_guard() { reset(); }
+            void reset()
+            {
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                    fd = -1;
+                }
+            }
+        };
+
+        // the length of the longest prefix of `s` that does not end inside a utf-8 sequence
+        size_t utf8_complete_prefix(const std::string& s)
+        {
+            size_t n = s.size();
+            // look at most 3 bytes back for the lead byte of a multi-byte sequence
+            for (size_t back = 1; back <= std::min<size_t>(3, n); ++back)
+            {
+                unsigned char c = s[n - back];
+                if ((c & 0xC0) == 0x80)
+                {
+                    continue; // continuation byte
+                }
+                size_t len = (c & 0x80) == 0 ? 1 : (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : (c & 0xF8) == 0xF0 ? 4 : 1;
+                return len > back ? n - back : n;
+            }
+            return n;
+        }
+
+        // output of one pipe that has not been published yet
+        struct pending_output
+        {
+            std::string name;
+            std::string data;
+            std::optional<clock::time_point> since;
+
+            void append(const char* bytes, size_t n)
+            {
+                if (!since)
+                {
+                    since = clock::now();
+                }
+                data.append(bytes, n);
+            }
+
+            bool due(clock::time_point now) const
+            {
+                return data.size() >= SHELL_FLUSH_BYTES || (since && now - *since >= SHELL_FLUSH_INTERVAL);
+            }
+
+            void flush(const shell_output_callback& publish, bool all)
+            {
+                size_t n = all ? data.size() : utf8_complete_prefix(data);
+                if (n > 0)
+                {
+                    publish(name, data.substr(0, n));
+                    data.erase(0, n);
+                }
+                since = data.empty() ? std::nullopt : std::optional(clock::now());
+            }
+        };
+
+        shell_status decode(int status)
+        {
+            if (WIFSIGNALED(status))
+            {
+                return { .exit_code = -1, .signal = WTERMSIG(status) };
+            }
+            return { .exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1, .signal = 0 };
+        }
+
+        int wait_for(pid_t pid)
+        {
+            int status = 0;
+            while (::waitpid(pid, &status, 0) < 0 && errno == EINTR)
+            {
+            }
+            return status;
+        }
+
+        // asks the process group to stop, and insists after a grace period
+        void terminate_group(pid_t pid)
+        {
+            ::kill(-pid, SIGTERM);
+            auto deadline = clock::now() + std::chrono::seconds(1);
+            int status = 0;
+            while (clock::now() < deadline)
+            {
+                if (::waitpid(pid, &status, WNOHANG) == pid)
+                {
+                    ::kill(-pid, SIGKILL); // stragglers in the group
+                    return;
+                }
+                ::usleep(10000);
+            }
+            ::kill(-pid, SIGKILL);
+            wait_for(pid);
+        }
+
+        // the script can outlive both of its pipes (`exec >&- 2>&-; sleep 600`), so the
+        // wait for it looks at the token too, backing off from 1 ms to 100 ms
+        int wait_for(pid_t pid, const cancellation_token& token)
+        {
+            auto delay = std::chrono::milliseconds(1);
+            while (true)
+            {
+                int status = 0;
+                pid_t reaped = ::waitpid(pid, &status, WNOHANG);
+                if (reaped == pid)
+                {
+                    return status;
+                }
+                if (reaped < 0 && errno != EINTR)
+                {
+                    throw nix::SysError("waiting for the shell");
+                }
+                token.check();
+                pollfd fd{ .fd = token.wait_fd(), .events = POLLIN, .revents = 0 };
+                ::poll(&fd, 1, static_cast<int>(delay.count()));
+                delay = std::min(delay * 2, std::chrono::milliseconds(100));
+            }
+        }
+
+        // the script's process group, terminated and reaped however run_shell_script is
+        // left unless the script was waited for: an interrupt, a failing poll, or an
+        // exception thrown by the output callback
+        struct process_group
+        {
+            pid_t pid;
+            bool reaped = false;
+
+            ~process_group()
+            {
+                if (!reaped)
+                {
+                    terminate_group(pid);
+                }
+            }
+
+            void terminate()
+            {
+                terminate_group(pid);
+                reaped = true;
+            }
+        };
+    }
+
+    shell_status run_shell_script(
+        const std::string& script,
+        const shell_output_callback& publish,
+        const cancellation_token& token
+    )
+    {
+        int out_pipe[2];
+        int err_pipe[2];
+        if (::pipe2(out_pipe, O_CLOEXEC) != 0)
+        {
+            throw nix::SysError("creating stdout pipe");
+        }
+        fd_guard out_read{ out_pipe[0] }, out_write{ out_pipe[1] };
+        if (::pipe2(err_pipe, O_CLOEXEC) != 0)
+        {
+            throw nix::SysError("creating stderr pipe");
+        }
+        fd_guard err_read{ err_pipe[0] }, err_write{ err_pipe[1] };
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+        posix_spawn_file_actions_adddup2(&actions, out_write.fd, STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, err_write.fd, STDERR_FILENO);
+
+        // a group of its own, so that an interrupt can take down everything the script started
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        sigset_t no_signals;
+        sigemptyset(&no_signals);
+        posix_spawnattr_setsigmask(&attr, &no_signals);
+        posix_spawnattr_setpgroup(&attr, 0);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+
+        const char* argv[] = { "sh", "-c", script.c_str(), nullptr };
+        pid_t pid = -1;
+        int rc = posix_spawn(&pid, "/bin/sh", &actions, &attr, const_cast<char* const*>(argv), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        posix_spawnattr_destroy(&attr);
+        if (rc != 0)
+        {
+            throw nix::SysError(rc, "running /bin/sh");
+        }
+        process_group group{ .pid = pid };
+        out_write.reset();
+        err_write.reset();
+
+        std::array<pending_output, 2> pending{ pending_output{ .name = "stdout", .data = {}, .since = {} },
+                                               pending_output{ .name = "stderr", .data = {}, .since = {} } };
+        // the token's eventfd comes last, it wakes the loop up as soon as it is cancelled
+        std::array<pollfd, 3> fds{ pollfd{ .fd = out_read.fd, .events = POLLIN, .revents = 0 },
+                                   pollfd{ .fd = err_read.fd, .events = POLLIN, .revents = 0 },
+                                   pollfd{ .fd = token.wait_fd(), .events = POLLIN, .revents = 0 } };
+        std::array<char, 65536> buffer;
+
+        try
+        {
+            while (fds[0].fd >= 0 || fds[1].fd >= 0)
+            {
+                token.check();
+
+                // wake up in time for the next flush, and regularly to notice lix interrupts
+                auto timeout = std::chrono::milliseconds(100);
+                for (const auto& p : pending)
+                {
+                    if (p.since)
+                    {
+                        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(*p.since + SHELL_FLUSH_INTERVAL - clock::now());
+                        timeout = std::max(std::chrono::milliseconds(0), std::min(timeout, left));
+                    }
+                }
+                if (::poll(fds.data(), fds.size(), static_cast<int>(timeout.count())) < 0 && errno != EINTR)
+                {
+                    throw nix::SysError("waiting for shell output");
+                }
+
+                for (size_t i = 0; i < pending.size(); ++i)
+                {
+                    if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                    {
+                        continue;
+                    }
+                    ssize_t n = ::read(fds[i].fd, buffer.data(), buffer.size());
+                    if (n > 0)
+                    {
+                        pending[i].append(buffer.data(), static_cast<size_t>(n));
+                    }
+                    else if (n == 0 || errno != EINTR)
+                    {
+                        fds[i].fd = -1; // end of output, poll skips negative descriptors
+                    }
+                }
+
+                auto now = clock::now();
+                for (auto& p : pending)
+                {
+                    if (p.due(now))
+                    {
+                        p.flush(publish, false);
+                    }
+                }
+            }
+        }
+        catch (const nix::Interrupted&)
+        {
+            group.terminate();
+            for (auto& p : pending)
+            {
+                p.flush(publish, true);
+            }
+            throw;
+        }
+
+        for (auto& p : pending)
+        {
+            p.flush(publish, true);
+        }
+        int status = wait_for(pid, token);
+        group.reaped = true;
+        return decode(status);
+    }
+}
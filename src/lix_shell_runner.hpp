@@ -0,0 +1,40 @@
+#ifndef XEUS_LIX_SHELL_RUNNER_HPP
+#define XEUS_LIX_SHELL_RUNNER_HPP
+
+#include "lix_cancellation.hpp"
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+namespace xeus_lix
+{
+    // how a shell command ended
+    struct shell_status
+    {
+        // the exit code, or -1 if the command was killed by a signal
+        int exit_code = 0;
+        int signal = 0;
+    };
+
+    // receives output as it arrives: the stream name ("stdout" or "stderr") and a chunk
+    // of text that never ends inside a utf-8 sequence
+    using shell_output_callback = std::function<void(const std::string&, const std::string&)>;
+
+    // runs `script` with /bin/sh in its own process group, stdin from /dev/null
+    // both pipes are read as they fill up, and output is passed on once FLUSH_BYTES have
+    // accumulated or FLUSH_INTERVAL has passed, so memory use does not grow with the
+    // amount of output. when `token` is cancelled the whole process group is terminated,
+    // then killed, and nix::Interrupted propagates; any other error does the same to it.
+    // the token is also watched while the script runs on after closing its output
+    shell_status run_shell_script(
+        const std::string& script,
+        const shell_output_callback& publish,
+        const cancellation_token& token
+    );
+
+    inline constexpr size_t SHELL_FLUSH_BYTES = 8192;
+    inline constexpr std::chrono::milliseconds SHELL_FLUSH_INTERVAL{ 50 };
+}
+
+#endif
@@ -0,0 +1,81 @@
+#include "lix_stream_buffer.hpp"
+
+namespace xeus_lix
+{
+    stream_buffer::stream_buffer(sink publish)
+        : m_publish(std::move(publish))
+        , m_owner(std::this_thread::get_id())
+    {
+    }
+
+    stream_buffer::~stream_buffer()
+    {
+        flush();
+    }
+
+    void stream_buffer::write(const std::string& name, const std::string& text)
+    {
+        if (text.empty())
+        {
+            return;
+        }
+        bool full = false;
+        {
+            std::lock_guard lock(m_mutex);
+            ++m_writes;
+            if (m_pending.empty())
+            {
+                m_first_write.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+            }
+            if (m_pending.empty() || m_pending.back().first != name)
+            {
+                m_pending.emplace_back(name, text);
+            }
+            else
+            {
+                m_pending.back().second += text;
+            }
+            m_pending_bytes += text.size();
+            full = m_pending_bytes >= STREAM_FLUSH_BYTES;
+        }
+        if (full)
+        {
+            flush();
+        }
+    }
+
+    void stream_buffer::flush()
+    {
+        if (!owned())
+        {
+            return;
+        }
+        std::vector<std::pair<std::string, std::string>> pending;
+        {
+            std::lock_guard lock(m_mutex);
+            pending.swap(m_pending);
+            m_pending_bytes = 0;
+            m_first_write.store(0, std::memory_order_relaxed);
+        }
+        // published without the lock: only this thread publishes, so nothing overtakes it
+        for (const auto& [name, text] : pending)
+        {
+            m_publish(name, text);
+            ++m_published;
+        }
+    }
+
+    void stream_buffer::flush_if_due()
+    {
+        auto first = m_first_write.load(std::memory_order_relaxed);
+        if (first == 0)
+        {
+            return;
+        }
+        auto age = std::chrono::steady_clock::now().time_since_epoch() - std::chrono::steady_clock::duration(first);
+        if (age >= STREAM_FLUSH_INTERVAL)
+        {
+            flush();
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef XEUS_LIX_STREAM_BUFFER_HPP
+#define XEUS_LIX_STREAM_BUFFER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace xeus_lix
+{
+    // merges consecutive writes to the same stream into one message
+    // anything else the kernel publishes flushes first, so the frontend sees everything in
+    // the order it was written. only the thread that created the buffer publishes: writes
+    // from other threads (e.g. a download warning) wait for it. pending text goes out once
+    // it reaches STREAM_FLUSH_BYTES, or at the first flush_if_due() after it is
+    // STREAM_FLUSH_INTERVAL old, so output from a long evaluation is not held back
+    class stream_buffer
+    {
+    public:
+        using sink = std::function<void(const std::string& name, const std::string& text)>;
+
+        explicit stream_buffer(sink publish);
+        ~stream_buffer();
+
+        stream_buffer(const stream_buffer&) = delete;
+        stream_buffer& operator=(const stream_buffer&) = delete;
+
+        void write(const std::string& name, const std::string& text);
+        // both do nothing off the owning thread
+        void flush();
+        void flush_if_due();
+
+        // messages handed to the sink, for `:stats`
+        size_t published() const { return m_published.load(std::memory_order_relaxed); }
+        size_t writes() const { return m_writes.load(std::memory_order_relaxed); }
+
+    private:
+        bool owned() const { return std::this_thread::get_id() == m_owner; }
+
+        sink m_publish;
+        std::thread::id m_owner;
+        std::mutex m_mutex;
+        // (stream name, text), a new entry whenever the stream changes
+        std::vector<std::pair<std::string, std::string>> m_pending;
+        size_t m_pending_bytes = 0;
+        // of the oldest pending write, in steady clock ticks; 0 while nothing is pending
+        std::atomic<std::chrono::steady_clock::rep> m_first_write = 0;
+        std::atomic<size_t> m_published = 0;
+        std::atomic<size_t> m_writes = 0;
+    };
+
+    inline constexpr size_t STREAM_FLUSH_BYTES = 16 * 1024;
+    inline constexpr std::chrono::milliseconds STREAM_FLUSH_INTERVAL{ 100 };
+}
+
+#endif
@@ -0,0 +1,72 @@
+#include "lix_symbol_index.hpp"
+
+#include <algorithm>
+
+namespace xeus_lix
+{
+    namespace
+    {
+        void sort_unique(std::vector<std::string_view>& names)
+        {
+            std::sort(names.begin(), names.end());
+            names.erase(std::unique(names.begin(), names.end()), names.end());
+        }
+    }
+
+    std::pair<name_iterator, name_iterator> prefix_range(const std::vector<std::string_view>& names, std::string_view prefix)
+    {
+        auto first = std::lower_bound(names.begin(), names.end(), prefix);
+        auto last = std::partition_point(first, names.end(), [&](std::string_view name) {
+            return name.starts_with(prefix);
+        });
+        return { first, last };
+    }
+
+    name_list::name_list(std::vector<std::string_view> sorted_names)
+        : names(std::move(sorted_names))
+    {
+        masks.reserve(names.size());
+        for (auto name : names)
+        {
+            masks.push_back(character_mask(name));
+        }
+    }
+
+    void symbol_index::set_builtins(std::vector<std::string_view> names)
+    {
+        sort_unique(names);
+        m_builtins = name_list(std::move(names));
+    }
+
+    void symbol_index::add(std::string_view name)
+    {
+        auto it = std::lower_bound(m_scope.names.begin(), m_scope.names.end(), name);
+        if (it == m_scope.names.end() || *it != name)
+        {
+            m_scope.masks.insert(m_scope.masks.begin() + (it - m_scope.names.begin()), character_mask(name));
+            m_scope.names.insert(it, name);
+        }
+    }
+
+    void symbol_index::add(std::vector<std::string_view> names)
+    {
+        // a batch (e.g. `:l <nixpkgs>`) is sorted on its own and merged in linear time
+        sort_unique(names);
+        std::vector<std::string_view> merged = std::move(m_scope.names);
+        auto middle = merged.insert(merged.end(), names.begin(), names.end());
+        std::inplace_merge(merged.begin(), middle, merged.end());
+        merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+        m_scope = name_list(std::move(merged));
+    }
+
+    void symbol_index::clear_scope()
+    {
+        m_scope = name_list();
+    }
+
+    bool symbol_index::contains(std::string_view name) const
+    {
+        return std::binary_search(m_scope.names.begin(), m_scope.names.end(), name)
+            || std::binary_search(m_builtins.names.begin(), m_builtins.names.end(), name);
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef XEUS_LIX_SYMBOL_INDEX_HPP
+#define XEUS_LIX_SYMBOL_INDEX_HPP
+
+#include "lix_fuzzy.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace xeus_lix
+{
+    using name_iterator = std::vector<std::string_view>::const_iterator;
+
+    // the sub-range of the sorted `names` that start with `prefix`
+    std::pair<name_iterator, name_iterator> prefix_range(const std::vector<std::string_view>& names, std::string_view prefix);
+
+    // sorted names together with the character_mask of each, kept wherever completion
+    // candidates are cached, so a keystroke skips most names without reading them
+    struct name_list
+    {
+        name_list() = default;
+        explicit name_list(std::vector<std::string_view> sorted_names);
+
+        std::vector<std::string_view> names;
+        std::vector<uint64_t> masks;
+    };
+
+    // calls `visit` for the names in `list` that may fuzzily match `pattern`, see may_match
+    template<typename Visitor>
+    void for_each_candidate(const name_list& list, std::string_view pattern, Visitor&& visit)
+    {
+        uint64_t mask = character_mask(pattern);
+        for (size_t i = 0; i < list.names.size(); ++i)
+        {
+            if (may_match(mask, list.masks[i]))
+            {
+                visit(list.names[i]);
+            }
+        }
+    }
+
+    // sorted index of the names visible at the top level of the REPL, used for completion
+    // the builtins are indexed once; names bound in the REPL scope are merged in as they
+    // are added. all names are views into the lix symbol table, so nothing is copied
+    class symbol_index
+    {
+    public:
+        void set_builtins(std::vector<std::string_view> names);
+        void add(std::string_view name);
+        void add(std::vector<std::string_view> names);
+        void clear_scope();
+
+        bool contains(std::string_view name) const;
+        size_t size() const { return m_builtins.names.size() + m_scope.names.size(); }
+
+        // calls `visit` once for every distinct name that may fuzzily match `pattern`, see
+        // may_match
+        template<typename Visitor>
+        void for_each_candidate(std::string_view pattern, Visitor&& visit) const
+        {
+            uint64_t mask = character_mask(pattern);
+            size_t b = 0;
+            size_t s = 0;
+            auto offer = [&](const name_list& list, size_t i) {
+                if (may_match(mask, list.masks[i]))
+                {
+                    visit(list.names[i]);
+                }
+            };
+            while (b < m_builtins.names.size() || s < m_scope.names.size())
+            {
+                if (s == m_scope.names.size() || (b < m_builtins.names.size() && m_builtins.names[b] < m_scope.names[s]))
+                {
+                    offer(m_builtins, b++);
+                }
+                else if (b == m_builtins.names.size() || m_scope.names[s] < m_builtins.names[b])
+                {
+                    offer(m_scope, s++);
+                }
+                else
+                {
+                    // bound in the scope and shadowing a builtin
+                    offer(m_scope, s++);
+                    ++b;
+                }
+            }
+        }
+
+        // calls `visit` once for every distinct name starting with `prefix`, in sorted order
+        template<typename Visitor>
+        void for_each_with_prefix(std::string_view prefix, Visitor&& visit) const
+        {
+            auto [b, b_end] = prefix_range(m_builtins.names, prefix);
+            auto [s, s_end] = prefix_range(m_scope.names, prefix);
+            while (b != b_end || s != s_end)
+            {
+                if (s == s_end || (b != b_end && *b < *s))
+                {
+                    visit(*b++);
+                }
+                else if (b == b_end || *s < *b)
+                {
+                    visit(*s++);
+                }
+                else
+                {
+                    // bound in the scope and shadowing a builtin
+                    visit(*s++);
+                    ++b;
+                }
+            }
+        }
+
+    private:
+        name_list m_builtins;
+        name_list m_scope;
+    };
+}
+
+#endif
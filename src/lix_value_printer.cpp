@@ -0,0 +1,267 @@
+#include "lix_value_printer.hpp"
+#include "lix_eval_budget.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+#include "lix/libexpr/print.hh"
+#include "lix/libutil/ansicolor.hh"
+#include "lix/libutil/error.hh"
+
+namespace xeus_lix
+{
+    namespace
+    {
+        std::string faint(const std::string& text)
+        {
+            return ANSI_FAINT + text + ANSI_NORMAL;
+        }
+
+        std::string elided(size_t count, bool list)
+        {
+            return faint(
+                "«" + std::to_string(count) + (list ? count == 1 ? " item" : " items" : count == 1 ? " attribute" : " attributes")
+                + " elided»"
+            );
+        }
+
+        std::string error_marker(const nix::Error& e)
+        {
+            std::string_view message = e.what();
+            return ANSI_RED "«" + std::string(message.substr(0, message.find('\n'))) + "»" ANSI_NORMAL;
+        }
+    }
+
+    value_printer::value_printer(nix::Evaluator& evaluator, nix::Value& value, print_limits limits)
+        : m_evaluator(evaluator)
+        , m_root(nix::allocRootValue(&value))
+        , m_limits(limits)
+    {
+    }
+
+    bool value_printer::force(nix::EvalState& state, nix::Value& v, const eval_budget& budget)
+    {
+        if (v.type() != nix::nThunk)
+        {
+            return true;
+        }
+        if (budget.expired())
+        {
+            return false;
+        }
+        try
+        {
+            state.forceValue(v, nix::noPos);
+            return true;
+        }
+        catch (const nix::Interrupted&)
+        {
+            if (budget.expired())
+            {
+                return false;
+            }
+            throw;
+        }
+    }
+
+    std::optional<std::string> value_printer::open(nix::EvalState& state, nix::Value& v, const eval_budget& budget)
+    {
+        try
+        {
+            if (!force(state, v, budget))
+            {
+                return std::nullopt;
+            }
+
+            if (v.type() == nix::nAttrs)
+            {
+                // a derivation is shown by its `.drv` path, as the REPL does, or with derivation_paths
+                // off by its name, which does not instantiate it; never as the set it is
+                auto type = v.attrs->get(m_evaluator.symbols.create("type"));
+                if (type)
+                {
+                    if (!force(state, *type->value, budget))
+                    {
+                        return std::nullopt;
+                    }
+                }
+                if (type && type->value->type() == nix::nString && std::string_view(type->value->str()) == "derivation")
+                {
+                    std::string text = ANSI_GREEN "«derivation";
+                    auto shown = v.attrs->get(m_evaluator.symbols.create(m_limits.derivation_paths ? "drvPath" : "name"));
+                    if (shown)
+                    {
+                        if (!force(state, *shown->value, budget))
+                        {
+                            return std::nullopt;
+                        }
+                        if (shown->value->type() == nix::nString)
+                        {
+                            text += " " + std::string(shown->value->str());
+                        }
+                    }
+                    return text + "»" ANSI_NORMAL;
+                }
+                if (v.attrs->empty())
+                {
+                    return "{ }";
+                }
+                if (m_stack.size() >= m_limits.max_depth)
+                {
+                    return "{ ... }";
+                }
+                frame f{ .list = false };
+                for (auto& attr : *v.attrs)
+                {
+                    std::ostringstream name;
+                    nix::printAttributeName(name, m_evaluator.symbols[attr.name]);
+                    f.items.emplace_back(name.str(), attr.value);
+                }
+                std::sort(f.items.begin(), f.items.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+                if (f.items.size() > m_limits.max_attrs)
+                {
+                    f.elided = f.items.size() - m_limits.max_attrs;
+                    f.items.resize(m_limits.max_attrs);
+                }
+                return open_frame(state, std::move(f), budget);
+            }
+
+            if (v.type() == nix::nList)
+            {
+                if (v.listSize() == 0)
+                {
+                    return "[ ]";
+                }
+                if (m_stack.size() >= m_limits.max_depth)
+                {
+                    return "[ ... ]";
+                }
+                frame f{ .list = true };
+                size_t shown = std::min<size_t>(v.listSize(), m_limits.max_list_items);
+                for (size_t i = 0; i < shown; ++i)
+                {
+                    f.items.emplace_back(std::string(), v.listElems()[i]);
+                }
+                f.elided = v.listSize() - shown;
+                return open_frame(state, std::move(f), budget);
+            }
+
+            std::ostringstream text;
+            nix::printValue(
+                state,
+                text,
+                v,
+                nix::PrintOptions{ .ansiColors = true, .force = false, .maxStringLength = m_limits.max_string_length }
+            );
+            return text.str();
+        }
+        catch (const nix::Error& e)
+        {
+            return error_marker(e);
+        }
+    }
+
+    std::optional<std::string> value_printer::open_frame(nix::EvalState& state, frame f, const eval_budget& budget)
+    {
+        // like nix::printValue, a lone item that is neither a set nor a list stays on one line
+        if (f.items.size() == 1 && f.elided == 0)
+        {
+            auto& [name, item] = f.items.front();
+            bool nested = false;
+            try
+            {
+                if (!force(state, *item, budget))
+                {
+                    return std::nullopt;
+                }
+                nested = item->type() == nix::nAttrs || item->type() == nix::nList;
+            }
+            catch (const nix::Error&)
+            {
+                // open() shows the error
+            }
+            if (!nested)
+            {
+                auto text = open(state, *item, budget);
+                if (!text)
+                {
+                    return std::nullopt;
+                }
+                return f.list ? "[ " + *text + " ]" : "{ " + name + " = " + *text + "; }";
+            }
+        }
+        bool list = f.list;
+        m_stack.push_back(std::move(f));
+        return list ? "[" : "{";
+    }
+
+    bool value_printer::print(nix::EvalState& state, std::string& out)
+    {
+        eval_budget budget(m_limits.time_budget);
+        size_t start = out.size();
+        auto stop = [&](size_t depth) {
+            std::string reason = budget.expired()
+                ? "stopped after " + std::to_string(m_limits.time_budget.count()) + " ms"
+                : "stopped after " + std::to_string(out.size() - start) + " bytes";
+            out += std::string(depth * 2, ' ') + faint("«" + reason + ", :p --more continues»");
+            return false;
+        };
+
+        if (!m_started)
+        {
+            auto text = open(state, **m_root, budget);
+            if (!text)
+            {
+                return stop(0);
+            }
+            m_started = true;
+            out += *text;
+        }
+        else
+        {
+            out += faint("«continued»");
+        }
+
+        while (!m_stack.empty())
+        {
+            out += '\n';
+            size_t depth = m_stack.size();
+            auto& top = m_stack.back();
+            if (top.next == top.items.size())
+            {
+                if (top.elided > 0)
+                {
+                    out += std::string(depth * 2, ' ') + elided(top.elided, top.list) + '\n';
+                }
+                bool list = top.list;
+                m_stack.pop_back();
+                out += std::string((depth - 1) * 2, ' ') + (list ? "]" : "}");
+                if (!m_stack.empty() && !m_stack.back().list)
+                {
+                    out += ';';
+                }
+                continue;
+            }
+            if (budget.expired() || out.size() - start >= m_limits.max_bytes)
+            {
+                return stop(depth);
+            }
+
+            auto [name, value] = top.items[top.next];
+            bool list = top.list;
+            // may push a frame, so `top` is not used past this
+            auto text = open(state, *value, budget);
+            if (!text)
+            {
+                return stop(depth);
+            }
+            ++m_stack[depth - 1].next;
+            out += std::string(depth * 2, ' ') + (list ? "" : name + " = ") + *text;
+            if (m_stack.size() == depth && !list)
+            {
+                out += ';';
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef XEUS_LIX_VALUE_PRINTER_HPP
+#define XEUS_LIX_VALUE_PRINTER_HPP
+
+#include "lix/libexpr/eval.hh"
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace xeus_lix
+{
+    class eval_budget;
+
+    struct print_limits
+    {
+        // sets and lists nested deeper print as `{ ... }` and `[ ... ]`
+        size_t max_depth;
+        // what a set or list holds beyond these is counted, not printed
+        size_t max_attrs;
+        size_t max_list_items;
+        size_t max_string_length;
+        // printing stops, resumably, once this much was written or this long spent
+        size_t max_bytes;
+        std::chrono::milliseconds time_budget;
+        // a derivation prints as its `.drv` path, which instantiates it, or else as its name
+        bool derivation_paths;
+    };
+
+    // prints a value the way nix::printValue does with `force`, but within limits
+    // the walk keeps its own stack rather than recursing, so when it runs out of bytes or
+    // time it stops where it is and a later `print` goes on from there. values are forced
+    // as they are reached and no further than weak head normal form; one whose forcing
+    // the time budget interrupted stays a thunk and is forced again on the next call
+    class value_printer
+    {
+    public:
+        value_printer(nix::Evaluator& evaluator, nix::Value& value, print_limits limits);
+
+        // appends the next part of the value to `out`; true once all of it was printed
+        bool print(nix::EvalState& state, std::string& out);
+
+    private:
+        struct frame
+        {
+            bool list;
+            // the printed attribute names, empty for lists
+            std::vector<std::pair<std::string, nix::Value*>> items;
+            size_t next = 0;
+            // left out by max_attrs or max_list_items
+            size_t elided = 0;
+        };
+
+        // forces `v` unless the budget runs out first, which it reports as false
+        bool force(nix::EvalState& state, nix::Value& v, const eval_budget& budget);
+        // the text `v` starts with: all of it, or the opening bracket of a set or list whose
+        // frame is pushed. nothing if the time ran out before it could be forced
+        std::optional<std::string> open(nix::EvalState& state, nix::Value& v, const eval_budget& budget);
+        // the opening of a set or list, or all of it if it fits on one line
+        std::optional<std::string> open_frame(nix::EvalState& state, frame f, const eval_budget& budget);
+
+        nix::Evaluator& m_evaluator;
+        // keeps the value and, through it, everything on the stack alive
+        nix::RootValue m_root;
+        print_limits m_limits;
+        std::vector<frame> m_stack;
+        bool m_started = false;
+    };
+
+    // for the result of a cell: nixpkgs printed by accident comes back within a second
+    inline constexpr print_limits RESULT_PRINT_LIMITS{
+        .max_depth = 8,
+        .max_attrs = 100,
+        .max_list_items = 100,
+        .max_string_length = 10000,
+        .max_bytes = 64 * 1024,
+        .time_budget = std::chrono::milliseconds{ 1000 },
+        .derivation_paths = false,
+    };
+    // for `:p`, which prints recursively, and for `:p --more`
+    inline constexpr print_limits DEEP_PRINT_LIMITS{
+        .max_depth = 64,
+        .max_attrs = 1000,
+        .max_list_items = 1000,
+        .max_string_length = 100000,
+        .max_bytes = 1024 * 1024,
+        .time_budget = std::chrono::milliseconds{ 1000 },
+        .derivation_paths = true,
+    };
+}
+
+#endif
@@ -1,21 +1,69 @@
+#include "lix_cancellation.hpp"
+#include "lix_eval_worker.hpp"
 #include "lix_interpreter.hpp"
+#include "lix_server.hpp"
 
 #include <lix/libexpr/eval.hh>
 #include <lix/libmain/shared.hh>
 #include <lix/libutil/signals.hh>
 
-#include "xeus-zmq/xserver_zmq.hpp"
 #include "xeus-zmq/xzmq_context.hpp"
 #include "xeus/xhelper.hpp"
 #include "xeus/xkernel.hpp"
 #include "xeus/xkernel_configuration.hpp"
 
 #include <csignal>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <string>
 
 void sigint_handler(int /*signum*/)
 {
-    nix::triggerInterrupt();
+    xeus_lix::request_interrupt();
+}
+
+// `--eval-stack-size <MiB>` sets the stack of the evaluation thread
+size_t eval_stack_size(int argc, char* argv[])
+{
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--eval-stack-size") == 0)
+        {
+            size_t mib = std::strtoull(argv[i + 1], nullptr, 10);
+            if (mib > 0)
+            {
+                return mib << 20;
+            }
+        }
+    }
+    return xeus_lix::DEFAULT_EVAL_STACK_SIZE;
+}
+
+// the value after `flag`, empty if it is not given
+std::string flag_value(int argc, char* argv[], const char* flag)
+{
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (std::strcmp(argv[i], flag) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return {};
+}
+
+// flags without a value, such as `--replay-session`
+bool has_flag(int argc, char* argv[], const char* flag)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], flag) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
 }
 
 int main(int argc, char* argv[])
@@ -46,19 +94,28 @@ int main(int argc, char* argv[])
         return 1;
     }
 
+    // lix is only ever touched from this thread, the kernel's threads hand requests to it
+    xeus_lix::eval_worker worker(eval_stack_size(argc, argv));
+
     auto context = xeus::make_zmq_context();
-    auto interpreter = std::make_unique<xeus_lix::interpreter>();
+    xeus_lix::interpreter_options options{ .replay_session = has_flag(argc, argv, "--replay-session"),
+                                           .prewarm = flag_value(argc, argv, "--prewarm") };
+    // cheap: lix itself is set up on the worker while the kernel already answers
+    auto interpreter = worker.call([&] { return std::make_unique<xeus_lix::interpreter>(worker, options); });
 
-    xeus::xkernel kernel(
+    auto kernel = std::make_unique<xeus::xkernel>(
         xeus::load_configuration(connection_file),
         xeus::get_user_name(),
         std::move(context),
         std::move(interpreter),
-        xeus::make_xserver_zmq
+        xeus_lix::make_control_server
     );
 
     std::cout << "Starting xeus-lix kernel..." << std::endl;
-    kernel.start();
+    kernel->start();
+
+    // the interpreter's lix state has to be torn down on the thread it was created on
+    worker.call([&] { kernel.reset(); });
 
     return 0;
 }
@@ -1,9 +1,11 @@
 import unittest
 import jupyter_kernel_test
 from jupyter_kernel_test import TIMEOUT, validate_message
+import math
 import re
 import os
 import shutil
+import time
 
 class LixKernelTests(jupyter_kernel_test.KernelTests):
     kernel_name = "lix"
@@ -50,6 +52,21 @@ class LixKernelTests(jupyter_kernel_test.KernelTests):
             if msg['parent_header']['msg_id'] == msg_id and msg['header']['msg_type'] == 'complete_reply':
                 return msg
 
+    # helper to read the counters reported by `:stats`
+    def _get_stats(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(code=':stats')
+        self.assertEqual(reply['content']['status'], 'ok')
+        stdout = "".join([msg['content']['text'] for msg in output_msgs if msg['header']['msg_type'] == 'stream' and msg['content']['name'] == 'stdout'])
+        stats = {}
+        for line in stdout.splitlines():
+            key, sep, value = line.partition(':')
+            words = value.split()
+            # counters only; lines such as `flake cache hit rate: N%` are read with a regex
+            if sep and words and words[0].isdigit():
+                stats[key.strip()] = int(words[0])
+        return stats
+
     def _strip_ansi(self, text):
         if not text:
             return ""
@@ -148,6 +165,9 @@ class LixKernelTests(jupyter_kernel_test.KernelTests):
 
     code_completion_samples = [
         {'code': 'builtins.toJ', 'matches': 'toJSON'},
+        {'code': 'let someLocal = 1; in someLo', 'matches': 'someLocal'},
+        {'code': '{ argOne, argTwo ? 1 }: argT', 'matches': 'argTwo'},
+        {'code': 'with builtins; toJ', 'matches': 'toJSON'},
         {'code': ':l', 'matches': ':load'},
         {'code': ':b', 'matches': ':b'},
         {'code': ':p', 'matches': ':print'},
@@ -249,6 +269,22 @@ class LixKernelTests(jupyter_kernel_test.KernelTests):
         reply, output_msgs = self.execute_helper(code='some_value')
         self.assertIn("12345", self._strip_ansi(output_msgs[0]['content']['data']['text/plain']))
 
+    def test_flake_outputs_come_from_eval_cache(self):
+        self.flush_channels()
+        reply, _ = self.execute_helper(code=':lf path:./test/test_flake')
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        # the first lookup may evaluate and record the value, the second one is answered by the cache
+        for _ in range(2):
+            reply, output_msgs = self.execute_helper(code=':t some_value')
+            text = "".join(msg['content']['text'] for msg in output_msgs if msg['header']['msg_type'] == 'stream')
+            self.assertIn("an integer", text)
+
+        reply, output_msgs = self.execute_helper(code=':stats')
+        stats = "".join(msg['content']['text'] for msg in output_msgs if msg['header']['msg_type'] == 'stream')
+        self.assertGreaterEqual(int(re.search(r"flake cache hits: (\d+)", stats).group(1)), 1)
+        self.assertIn("flake cache hit rate:", stats)
+
     def test_shell_command(self):
         self.flush_channels()
         reply, output_msgs = self.execute_helper(code='!echo "hello from shell"')
@@ -301,5 +337,557 @@ class LixKernelTests(jupyter_kernel_test.KernelTests):
         self.assertGreaterEqual(len(output_msgs), 1)
         self.assertIn("an integer", output_msgs[0]['content']['text'])
 
+    def test_large_cell_is_parsed_once_per_chunk(self):
+        lines = ["big_cell = {"] + [f"  attr{i} = {{ value = {i}; name = \"a{i}\"; }};" for i in range(300)] + ["};", "big_cell.attr299.value"]
+        code = "\n".join(lines)
+
+        before = self._get_stats()['parses']
+        self.flush_channels()
+        start = time.monotonic()
+        reply, output_msgs = self.execute_helper(code=code)
+        elapsed = time.monotonic() - start
+        after = self._get_stats()['parses']
+
+        self.assertEqual(reply['content']['status'], 'ok')
+        results = [msg for msg in output_msgs if msg['msg_type'] == 'execute_result']
+        self.assertEqual(len(results), 1)
+        self.assertEqual(self._strip_ansi(results[0]['content']['data']['text/plain']).strip(), '299')
+        # one parse for the binding and one for the final expression
+        self.assertEqual(after - before, 2)
+        self.assertLess(elapsed, 5.0)
+
+    def test_is_complete_then_execute_reuses_parse(self):
+        code = f'{{ stamp = {time.time_ns()}; }}.stamp + 1'
+        before = self._get_stats()
+
+        self.flush_channels()
+        msg = self.kc.session.msg('is_complete_request', {'code': code})
+        self.kc.shell_channel.send(msg)
+        reply = self.kc.get_shell_msg(timeout=TIMEOUT)
+        validate_message(reply, 'is_complete_reply', msg['header']['msg_id'])
+        self.assertEqual(reply['content']['status'], 'complete')
+
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(code=code)
+        self.assertEqual(reply['content']['status'], 'ok')
+        after = self._get_stats()
+
+        self.assertEqual(after['parses'] - before['parses'], 1)
+        self.assertGreaterEqual(after['parse cache hits'] - before['parse cache hits'], 1)
+
+    def test_dotted_completion_reuses_attr_names(self):
+        for code in ['pkgs.lib.str', 'pkgs.lib.strings.con', 'pkgs.lib.strings.con']:
+            self.flush_channels()
+            msg_id = self.kc.complete(code)
+            reply = self.get_completion_reply(msg_id)
+            self.assertEqual(reply["content"]["status"], "ok")
+            base = code.rsplit('.', 1)[0] + '.'
+            self.assertTrue(all(m.startswith(base) for m in reply["content"]["matches"]))
+        self.assertIn('pkgs.lib.strings.concatStrings', reply["content"]["matches"])
+
+        stats = self._get_stats()
+        self.assertGreaterEqual(stats['attr cache hits'], 2)
+
+    # seconds until the shell reply to the request `send` makes
+    def _round_trip(self, send, reply_type):
+        self.flush_channels()
+        start = time.monotonic()
+        msg_id = send()
+        while True:
+            msg = self.kc.get_shell_msg(timeout=TIMEOUT)
+            if msg['parent_header']['msg_id'] == msg_id and msg['header']['msg_type'] == reply_type:
+                return time.monotonic() - start, msg
+
+    def _p99(self, samples):
+        samples = sorted(samples)
+        return samples[math.ceil(len(samples) * 0.99) - 1]
+
+    def test_top_level_completion_latency(self):
+        # the scope holds all of nixpkgs after `:l <nixpkgs>` in setUpClass
+        # 500 samples, so the p99 is not just the second slowest one
+        samples = 500
+        baseline = [self._round_trip(self.kc.kernel_info, 'kernel_info_reply')[0] for _ in range(samples)]
+        latencies = []
+        for _ in range(samples):
+            latency, reply = self._round_trip(lambda: self.kc.complete('python3Pa'), 'complete_reply')
+            latencies.append(latency)
+            self.assertIn('python3Packages', reply["content"]["matches"])
+
+        # a kernel_info round trip does no work in the kernel, so what completion adds on top
+        # of it is the cost of looking the prefix up
+        self.assertLess(self._p99(latencies) - self._p99(baseline), 0.05)
+
+    def test_completion_scope_ends_with_the_lambda_and_respects_shadowing(self):
+        # the argument of a lambda on an earlier line is not in scope on the next one
+        self.flush_channels()
+        msg_id = self.kc.complete('f = lambdaArgument: lambdaArgument\nlambdaArg')
+        reply = self.get_completion_reply(msg_id)
+        self.assertNotIn('lambdaArgument', reply["content"]["matches"])
+
+        # `with lib;` offers the REPL's lib, but not over a let-bound `lib`
+        self.flush_channels()
+        msg_id = self.kc.complete('with lib; optionalStrin')
+        reply = self.get_completion_reply(msg_id)
+        self.assertIn('optionalString', reply["content"]["matches"])
+        self.flush_channels()
+        msg_id = self.kc.complete('let lib = { }; in with lib; optionalStrin')
+        reply = self.get_completion_reply(msg_id)
+        self.assertNotIn('optionalString', reply["content"]["matches"])
+
+    def test_fuzzy_completion_is_ranked_and_bounded(self):
+        self.flush_channels()
+        msg_id = self.kc.complete('pkgs.pyth3Pkgs')
+        reply = self.get_completion_reply(msg_id)
+        self.assertEqual(reply["content"]["status"], "ok")
+        self.assertIn('pkgs.python3Packages', reply["content"]["matches"])
+
+        # the match does not have to start where the name does
+        self.flush_channels()
+        msg_id = self.kc.complete('pkgs.icropython')
+        reply = self.get_completion_reply(msg_id)
+        self.assertIn('pkgs.micropython', reply["content"]["matches"])
+
+        # prefix matches rank first, and the whole of nixpkgs is not sent back
+        self.flush_channels()
+        msg_id = self.kc.complete('pkgs.')
+        reply = self.get_completion_reply(msg_id)
+        self.assertLessEqual(len(reply["content"]["matches"]), 200)
+        self.flush_channels()
+        msg_id = self.kc.complete('pkgs.hell')
+        reply = self.get_completion_reply(msg_id)
+        self.assertEqual(reply["content"]["matches"][0], 'pkgs.hello')
+
+    def test_lix_search_command(self):
+        self.flush_channels()
+        code = """
+        searchSet = {
+          hello = pkgs.hello;
+          nested = { recurseForDerivations = true; cowsay = pkgs.cowsay; };
+          hidden = { figlet = pkgs.figlet; };
+          broken = throw "not a package";
+        }
+        """
+        reply, _ = self.execute_helper(code=code)
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        def search(query):
+            self.flush_channels()
+            reply, output_msgs = self.execute_helper(code=f':search {query} in searchSet')
+            self.assertEqual(reply['content']['status'], 'ok')
+            return "".join(msg['content']['data']['text/markdown'] for msg in output_msgs if msg['header']['msg_type'] == 'display_data')
+
+        table = search('cow|hello')
+        self.assertIn('`nested.cowsay`', table)
+        self.assertIn('`hello`', table)
+        self.assertIn('1 attributes failed to evaluate', table)
+        self.assertNotIn('figlet', search('figlet'))
+        # served from the index built by the first query
+        self.assertIn('`nested.cowsay`', search('COWSAY'))
+
+    def test_lix_apropos_command(self):
+        def apropos(query):
+            self.flush_channels()
+            reply, output_msgs = self.execute_helper(code=f':apropos {query}')
+            self.assertEqual(reply['content']['status'], 'ok')
+            return "".join(msg['content']['data']['text/markdown'] for msg in output_msgs if msg['header']['msg_type'] == 'display_data')
+
+        self.assertIn('`builtins.toJSON`', apropos('json'))
+        self.assertIn('concatStrings`', apropos('concatenate strings in pkgs.lib'))
+        # the second lookup is answered from the index built by the first
+        self.assertIn('concatStrings`', apropos('concatenate in pkgs.lib'))
+
+    def test_repeated_inspect_hits_doc_cache(self):
+        code = 'pkgs.lib.strings.concatMapStrings'
+        before = self._get_stats()
+        for _ in range(3):
+            self.flush_channels()
+            msg_id = self.kc.inspect(code, len(code))
+            reply = self.kc.get_shell_msg(timeout=TIMEOUT)
+            validate_message(reply, "inspect_reply", msg_id)
+            self.assertTrue(reply["content"]["found"])
+        after = self._get_stats()
+        self.assertLessEqual(after['doc cache misses'] - before['doc cache misses'], 1)
+        self.assertGreaterEqual(after['doc cache hits'] - before['doc cache hits'], 2)
+
+    def test_inspect_does_not_block_on_expensive_thunks(self):
+        code = "slowThunk = builtins.foldl' (acc: _: acc + builtins.length (builtins.genList (x: x) 100000)) 0 (builtins.genList (x: x) 100000)"
+        self.flush_channels()
+        reply, _ = self.execute_helper(code=code)
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        self.flush_channels()
+        start = time.monotonic()
+        msg_id = self.kc.inspect('slowThunk')
+        reply = self.get_non_kernel_info_reply(timeout=TIMEOUT)
+        self.assertLess(time.monotonic() - start, 2)
+        validate_message(reply, "inspect_reply", msg_id)
+        self.assertTrue(reply["content"]["found"])
+        self.assertIn("unevaluated thunk", reply["content"]["data"]["text/markdown"])
+
+        # the kernel is still usable afterwards
+        self.flush_channels()
+        reply, _ = self.execute_helper(code='1 + 1')
+        self.assertEqual(reply['content']['status'], 'ok')
+
+    def test_inspect_describes_derivations(self):
+        self.flush_channels()
+        msg_id = self.kc.inspect('pkgs.hello', detail_level=1)
+        reply = self.get_non_kernel_info_reply(timeout=TIMEOUT)
+        validate_message(reply, "inspect_reply", msg_id)
+        text = reply["content"]["data"]["text/markdown"]
+        self.assertIn("derivation `hello-", text)
+        self.assertIn("defined at", text)
+
+    def test_shell_command_streams_and_reports_status(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(code='!echo first; sleep 0.5; echo second; echo oops 1>&2; exit 3')
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        streams = [msg['content'] for msg in output_msgs if msg['header']['msg_type'] == 'stream']
+        stdout = [s['text'] for s in streams if s['name'] == 'stdout']
+        stderr = "".join(s['text'] for s in streams if s['name'] == 'stderr')
+        # published as it came, not all at once after the command finished
+        self.assertEqual(stdout, ['first\n', 'second\n'])
+        self.assertIn('oops', stderr)
+        self.assertIn('exited with status 3', stderr)
+
+    # time from interrupting the kernel to the reply of the interrupted request
+    def _interrupt_latency(self, code):
+        self.flush_channels()
+        msg_id = self.kc.execute(code)
+        time.sleep(1.0)
+        start = time.monotonic()
+        self.km.interrupt_kernel()
+        while True:
+            reply = self.kc.get_shell_msg(timeout=TIMEOUT)
+            if reply['parent_header'].get('msg_id') == msg_id:
+                break
+        latency = time.monotonic() - start
+        self.assertEqual(reply['content']['status'], 'error')
+        return latency
+
+    def test_interrupt_latency(self):
+        work = {
+            'eval': "builtins.foldl' (acc: _: acc + builtins.length (builtins.genList (x: x) 100000)) 0 (builtins.genList (x: x) 100000)",
+            'shell': '!sleep 60',
+            'build': ':b pkgs.runCommand "slow-${toString builtins.currentTime}" {} "sleep 60; touch $out"',
+        }
+        for kind, code in work.items():
+            with self.subTest(kind=kind):
+                self.assertLess(self._interrupt_latency(code), 3.0)
+        # the session survives
+        self.flush_channels()
+        reply, _ = self.execute_helper(code='1 + 1')
+        self.assertEqual(reply['content']['status'], 'ok')
+
+    def test_control_channel_answers_during_evaluation(self):
+        self.flush_channels()
+        msg_id = self.kc.execute("builtins.foldl' (acc: _: acc + builtins.length (builtins.genList (x: x) 100000)) 0 (builtins.genList (x: x) 100000)")
+        time.sleep(1.0)
+
+        # the interrupt request is answered from the control thread, not after the evaluation
+        start = time.monotonic()
+        request = self.kc.session.msg('interrupt_request', {})
+        self.kc.control_channel.send(request)
+        reply = self.kc.control_channel.get_msg(timeout=TIMEOUT)
+        self.assertLess(time.monotonic() - start, 1.0)
+        self.assertEqual(reply['header']['msg_type'], 'interrupt_reply')
+
+        # and it stopped the evaluation
+        while True:
+            reply = self.kc.get_shell_msg(timeout=TIMEOUT)
+            if reply['parent_header'].get('msg_id') == msg_id:
+                break
+        self.assertEqual(reply['content']['status'], 'error')
+
+    def test_completion_answers_during_execution(self):
+        self.flush_channels()
+        exec_id = self.kc.execute('!sleep 20')
+        time.sleep(1.0)
+
+        # the evaluator is busy with the cell, completion is served from the indexed names
+        start = time.monotonic()
+        msg_id = self.kc.complete('builtins.toStr', 14)
+        reply = self.get_non_kernel_info_reply(timeout=TIMEOUT)
+        self.assertLess(time.monotonic() - start, 1.0)
+        validate_message(reply, 'complete_reply', msg_id)
+
+        msg_id = self.kc.complete('builti', 6)
+        reply = self.get_non_kernel_info_reply(timeout=TIMEOUT)
+        self.assertLess(time.monotonic() - start, 2.0)
+        self.assertIn('builtins', reply['content']['matches'])
+
+        msg_id = self.kc.inspect('builtins', 8)
+        reply = self.get_non_kernel_info_reply(timeout=TIMEOUT)
+        self.assertLess(time.monotonic() - start, 3.0)
+        validate_message(reply, 'inspect_reply', msg_id)
+
+        self.km.interrupt_kernel()
+        while True:
+            reply = self.kc.get_shell_msg(timeout=TIMEOUT)
+            if reply['parent_header'].get('msg_id') == exec_id:
+                break
+
+    def test_background_build_jobs(self):
+        self.flush_channels()
+        # instantiating the first derivation evaluates stdenv, which is not what is timed here
+        reply, output_msgs = self.execute_helper(code='(pkgs.runCommand "bg-warm" {} "touch $out").drvPath')
+        self.assertEqual(reply['content']['status'], 'ok')
+        start = time.monotonic()
+        reply, output_msgs = self.execute_helper(
+            code=':b pkgs.runCommand "bg-${toString builtins.currentTime}" {} "sleep 3; echo hello-bg > $out" &'
+        )
+        self.assertEqual(reply['content']['status'], 'ok')
+        self.assertLess(time.monotonic() - start, 3.0)
+        shown = [msg for msg in output_msgs if msg['header']['msg_type'] == 'display_data']
+        self.assertTrue(shown[0]['content']['transient']['display_id'])
+        self.assertIn('[1] building', shown[0]['content']['data']['text/plain'])
+
+        # the kernel keeps evaluating while the build runs
+        reply, output_msgs = self.execute_helper(code='1 + 1')
+        self.assertEqual(reply['content']['status'], 'ok')
+        reply, output_msgs = self.execute_helper(code=':jobs')
+        self.assertIn('running', str(output_msgs))
+
+        reply, output_msgs = self.execute_helper(code=':wait 1')
+        self.assertEqual(reply['content']['status'], 'ok')
+        self.assertIn('[1] built', str(output_msgs))
+
+        # a killed build reports so, and waiting on it fails
+        reply, output_msgs = self.execute_helper(
+            code=':b pkgs.runCommand "bg-kill-${toString builtins.currentTime}" {} "sleep 60; touch $out" &'
+        )
+        reply, output_msgs = self.execute_helper(code=':kill 2')
+        self.assertIn('killed', str(output_msgs))
+        reply, output_msgs = self.execute_helper(code=':wait 2')
+        self.assertEqual(reply['content']['status'], 'error')
+
+    def test_build_several_derivations_in_one_batch(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(code='''batch = {
+          ok = pkgs.runCommand "batch-ok-${toString builtins.currentTime}" {} "echo ok > $out";
+          bad = pkgs.runCommand "batch-bad-${toString builtins.currentTime}" {} "exit 1";
+          also = pkgs.runCommand "batch-also-${toString builtins.currentTime}" {} "sleep 1; touch $out";
+        }''')
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        # the failure does not stop the other builds, and the cell fails once they are done
+        reply, output_msgs = self.execute_helper(code=':b batch', timeout=120)
+        self.assertEqual(reply['content']['status'], 'error')
+        tables = [msg['content']['data']['text/markdown'] for msg in output_msgs
+                  if msg['header']['msg_type'] == 'display_data' and 'text/markdown' in msg['content']['data']]
+        self.assertEqual(len(tables), 1)
+        self.assertRegex(tables[0], r'\| ok \| built \|')
+        self.assertRegex(tables[0], r'\| also \| built \|')
+        self.assertRegex(tables[0], r'\| bad \| failed \|')
+        errors = [msg for msg in output_msgs if msg['header']['msg_type'] == 'error']
+        self.assertIn('1 of 3 derivations failed to build', errors[0]['content']['evalue'])
+
+        # lists are built the same way, and outputs already there are not built again
+        reply, output_msgs = self.execute_helper(code=':b [ batch.ok batch.also ]', timeout=120)
+        self.assertEqual(reply['content']['status'], 'ok')
+        self.assertIn('| 0 | already valid |', str(output_msgs))
+        self.assertIn('| 1 | already valid |', str(output_msgs))
+
+    def test_build_progress_is_throttled(self):
+        self.flush_channels()
+        code = ':b pkgs.runCommand "chatty-${toString builtins.currentTime}" {} "for i in $(seq 1 20000); do echo line $i; done; sleep 1; touch $out"'
+        reply, output_msgs = self.execute_helper(code=code, timeout=120)
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        progress = [msg for msg in output_msgs if msg['header']['msg_type'] in ('display_data', 'update_display_data')
+                    and msg['content'].get('transient', {}).get('display_id', '').startswith('xeus-lix-progress-')]
+        self.assertTrue(progress)
+        # one display for the cell, redrawn a few times a second rather than once per log line
+        self.assertEqual(progress[0]['header']['msg_type'], 'display_data')
+        self.assertLess(len(progress), 200)
+        self.assertIn('built 1/1', progress[-1]['content']['data']['text/plain'])
+
+    def test_trace_output_is_coalesced(self):
+        self.flush_channels()
+        code = "builtins.foldl' (acc: i: builtins.trace \"line ${toString i}\" (acc + i)) 0 (builtins.genList (x: x) 5000)"
+        reply, output_msgs = self.execute_helper(code=code)
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        streams = [msg for msg in output_msgs if msg['header']['msg_type'] == 'stream']
+        text = "".join(msg['content']['text'] for msg in streams)
+        # every line arrives, in order, in far fewer messages than lines
+        self.assertIn("line 0\n", text)
+        self.assertLess(text.index("line 4998"), text.index("line 4999"))
+        self.assertLess(len(streams), 100)
+        # the result still comes after the output that preceded it
+        kinds = [msg['header']['msg_type'] for msg in output_msgs]
+        self.assertGreater(kinds.index('execute_result'), kinds.index('stream'))
+
+    def test_scope_grows_and_keeps_rebinding_semantics(self):
+        self.flush_channels()
+        # enough bindings to need several env segments
+        code = ':a builtins.listToAttrs (builtins.genList (i: { name = "grow${toString i}"; value = i; }) 3000)'
+        reply, _ = self.execute_helper(code=code)
+        self.assertEqual(reply['content']['status'], 'ok')
+        reply, output_msgs = self.execute_helper(code='grow0 + grow2999')
+        self.assertIn("2999", self._strip_ansi(output_msgs[0]['content']['data']['text/plain']))
+
+        # a rebound name does not change what earlier code captured
+        reply, output_msgs = self.execute_helper(code='rebound = 1\ncapture = _: rebound\nrebound = 2\n[ (capture null) rebound ]')
+        self.assertEqual(reply['content']['status'], 'ok')
+        self.assertRegex(self._strip_ansi(output_msgs[-1]['content']['data']['text/plain']), r"\[\s*1\s+2\s*\]")
+
+        reply, output_msgs = self.execute_helper(code=':stats')
+        stats = "".join(msg['content']['text'] for msg in output_msgs if msg['header']['msg_type'] == 'stream')
+        capacity = int(re.search(r"scope bindings: \d+ of (\d+) slots", stats).group(1))
+        self.assertLess(capacity, 1 << 20)
+
+    def test_reload_only_evaluates_changed_files(self):
+        self.flush_channels()
+        with open("test/reload_a.nix", "w") as f:
+            f.write('{ reloadA = (import ./reload_b.nix).b; }')
+        with open("test/reload_b.nix", "w") as f:
+            f.write('{ b = 1; }')
+        with open("test/reload_c.nix", "w") as f:
+            f.write('{ reloadC = 3; }')
+        try:
+            self.execute_helper(code=':l test/reload_a.nix')
+            self.execute_helper(code=':l test/reload_c.nix')
+
+            with open("test/reload_b.nix", "w") as f:
+                f.write('{ b = 2; }')
+            reply, output_msgs = self.execute_helper(code=':reload')
+            self.assertEqual(reply['content']['status'], 'ok')
+            text = "".join(msg['content']['text'] for msg in output_msgs if msg['header']['msg_type'] == 'stream')
+            self.assertRegex(text, r"Reloading \S*reload_a\.nix")
+            self.assertRegex(text, r"Unchanged \S*reload_c\.nix")
+
+            reply, output_msgs = self.execute_helper(code='reloadA + reloadC')
+            self.assertEqual(self._strip_ansi(output_msgs[0]['content']['data']['text/plain']).strip(), "5")
+        finally:
+            for name in ("reload_a", "reload_b", "reload_c"):
+                os.remove(f"test/{name}.nix")
+
+    def test_session_replay_after_restart(self):
+        from jupyter_client.manager import start_new_kernel
+
+        env = dict(os.environ, JPY_SESSION_NAME=f"replay-test-{os.getpid()}-{time.time()}")
+        def run(kc, code):
+            text = []
+            def hook(msg):
+                if msg['header']['msg_type'] == 'stream':
+                    text.append(msg['content']['text'])
+                elif msg['header']['msg_type'] == 'execute_result':
+                    text.append(msg['content']['data']['text/plain'])
+            reply = kc.execute_interactive(code, timeout=TIMEOUT, output_hook=hook)
+            return reply, self._strip_ansi("".join(text))
+
+        km, kc = start_new_kernel(kernel_name=self.kernel_name, extra_arguments=["--replay-session"], env=env)
+        try:
+            # loading the same file again is recorded once
+            for _ in range(2):
+                reply, _ = run(kc, ':l test/test.nix')
+                self.assertEqual(reply['content']['status'], 'ok')
+        finally:
+            kc.stop_channels()
+            km.shutdown_kernel(now=True)
+
+        km, kc = start_new_kernel(kernel_name=self.kernel_name, extra_arguments=["--replay-session"], env=env)
+        try:
+            # the cell waits behind the replay, which brings the file back without being asked
+            reply, text = run(kc, 'value')
+            self.assertEqual(reply['content']['status'], 'ok')
+            self.assertIn("42", text)
+            reply, text = run(kc, ':stats')
+            self.assertRegex(text, r"session replay: 1 of 1 commands in \d+ ms")
+        finally:
+            kc.stop_channels()
+            km.shutdown_kernel(now=True)
+
+    def test_startup_answers_before_lix_is_ready(self):
+        from jupyter_client.manager import start_new_kernel
+
+        started = time.monotonic()
+        # start_new_kernel returns once kernel_info is answered
+        # a prewarm that takes far longer than lix takes to set up, so the cell always comes first
+        slow = "builtins.foldl' (a: i: a + builtins.foldl' builtins.add 0 (builtins.genList (j: j) 10000)) 0 (builtins.genList (i: i) 10000)"
+        km, kc = start_new_kernel(kernel_name=self.kernel_name, extra_arguments=["--prewarm", slow])
+        try:
+            ready = time.monotonic() - started
+            text = []
+            def hook(msg):
+                if msg['header']['msg_type'] == 'stream':
+                    text.append(msg['content']['text'])
+            # the first cell waits for lix, but not for the prewarm
+            reply = kc.execute_interactive(':stats', timeout=TIMEOUT, output_hook=hook)
+            first_cell = time.monotonic() - started
+            self.assertEqual(reply['content']['status'], 'ok')
+            stats = "".join(text)
+            self.assertRegex(stats, r"startup: lix ready \d+ ms after start")
+            self.assertRegex(stats, r"prewarm: interrupted by a cell in \d+ ms")
+            print(f"\nkernel_info after {ready:.2f}s, first cell after {first_cell:.2f}s")
+        finally:
+            kc.stop_channels()
+            km.shutdown_kernel(now=True)
+
+    def test_log_tail_and_grep(self):
+        self.flush_channels()
+        cached_before = self._get_stats()['build logs cached']
+        reply, output_msgs = self.execute_helper(
+            code='noisy = pkgs.runCommand "noisy-${toString builtins.currentTime}" {} "for i in $(seq 1 500); do echo noisy-line-$i; done; touch $out"')
+        reply, output_msgs = self.execute_helper(code=':b noisy', timeout=120)
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        def stdout_of(code):
+            reply, output_msgs = self.execute_helper(code=code)
+            self.assertEqual(reply['content']['status'], 'ok')
+            return "".join(msg['content']['text'] for msg in output_msgs
+                           if msg['header']['msg_type'] == 'stream' and msg['content']['name'] == 'stdout')
+
+        text = stdout_of(':log --tail 2 noisy')
+        self.assertIn('noisy-line-499\n', text)
+        self.assertIn('noisy-line-500\n', text)
+        self.assertNotIn('noisy-line-498\n', text)
+
+        text = stdout_of(":log --grep 'line-4[0-9]$' noisy")
+        self.assertIn('noisy-line-45\n', text)
+        self.assertNotIn('noisy-line-450', text)
+        self.assertNotIn('noisy-line-5\n', text)
+
+        # the log was fetched once and then served from the session's cache
+        self.assertIn('noisy-line-1\n', stdout_of(':log noisy'))
+        self.assertEqual(self._get_stats()['build logs cached'] - cached_before, 1)
+
+    def test_printing_is_bounded_and_continues(self):
+        self.flush_channels()
+        # printing nixpkgs by accident comes back quickly, cut short
+        start = time.monotonic()
+        reply, output_msgs = self.execute_helper(code='pkgs')
+        self.assertEqual(reply['content']['status'], 'ok')
+        self.assertLess(time.monotonic() - start, 5.0)
+        results = [msg for msg in output_msgs if msg['header']['msg_type'] == 'execute_result']
+        self.assertRegex(self._strip_ansi(results[0]['content']['data']['text/plain']), r'«(stopped after|\d+ attributes elided)')
+
+        reply, output_msgs = self.execute_helper(code='builtins.genList (x: x) 1000')
+        results = [msg for msg in output_msgs if msg['header']['msg_type'] == 'execute_result']
+        self.assertIn('«900 items elided»', self._strip_ansi(results[0]['content']['data']['text/plain']))
+
+        def stdout_of(code):
+            reply, output_msgs = self.execute_helper(code=code)
+            self.assertEqual(reply['content']['status'], 'ok')
+            return self._strip_ansi("".join(msg['content']['text'] for msg in output_msgs
+                                            if msg['header']['msg_type'] == 'stream' and msg['content']['name'] == 'stdout'))
+
+        # `:p` stops after a megabyte and `:p --more` goes on from where it stopped
+        text = stdout_of(':p builtins.genList (i: builtins.genList (j: "${toString i}-${toString j}") 1000) 1000')
+        self.assertIn(':p --more continues', text)
+        self.assertIn('"0-0"', text)
+        self.assertNotIn('"999-999"', text)
+        for _ in range(30):
+            text = stdout_of(':p --more')
+            self.assertTrue(text.startswith('«continued»'))
+            if ':p --more continues' not in text:
+                break
+        self.assertIn('"999-999"', text)
+
+        reply, output_msgs = self.execute_helper(code=':p --more')
+        self.assertIn('Nothing more to print', str(output_msgs))
+
 if __name__ == "__main__":
     unittest.main()